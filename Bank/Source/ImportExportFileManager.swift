@@ -155,13 +155,14 @@ final class ImportExportFileManager {
   :param: file String
   */
   class func exportItems(items: [JSONValueConvertible], toFile file: String) {
-    let jsonString: String?
-    switch items.count {
-      case 0:  jsonString = nil
-      case 1:  jsonString = items.first?.jsonValue.prettyRawValue
-      default: jsonString = JSONValue(items)?.prettyRawValue
-    }
-    jsonString?.writeToFile(file)
+    if items.isEmpty { return }
+    if let writer = JSONWriter.writerForFileAtPath(file, options: JSONSerialization.WriteOptions.Prettified) {
+      // Items are converted and written one at a time rather than assembled into a single string
+      if items.count == 1 { writer.writeValue(items[0].jsonValue) }
+      else { writer.beginArray(); apply(items) { writer.writeValue($0.jsonValue) }; writer.endArray() }
+      writer.close()
+      MSHandleError(writer.error, message: "failed to export items to '\(file)'")
+    } else { MSLogError("unable to open '\(file)' for writing") }
   }
 
   /**
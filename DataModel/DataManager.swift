@@ -264,7 +264,9 @@ import MoonKit
   }
 
   /**
-  loadJSONFileAtPath:forModel:context:logFlags:completion:
+  Parses the file and imports its objects into `context`. The elements of a root array are imported as they are parsed,
+  into a child of `context` that is only saved once the whole file has parsed, so a file that fails to parse part way
+  through imports nothing.
 
   :param: path String
   :param: type T.Type
@@ -281,7 +283,10 @@ import MoonKit
     MSLogDebug("parsing file '\(path)'")
 
     var error: NSError?
-    context.performBlockAndWait {
+    let importContext = NSManagedObjectContext(concurrencyType: .PrivateQueueConcurrencyType)
+    importContext.parentContext = context
+    importContext.nametag = "\(context.nametag ?? "")<import>"
+    importContext.performBlockAndWait {
 
       if hasOption(LogFlags.File, logFlags),
         let contents = String(contentsOfFile: path, encoding: NSUTF8StringEncoding, error: nil)
@@ -289,6 +294,14 @@ import MoonKit
         MSLogDebug("content of file to parse:\n\(contents)")
       }
 
+      // Elements of a root array are imported as they are parsed unless the parsed tree is to be logged
+      var importedObjects: [ModelObject] = []
+      let importElement = {(element: JSONValue) -> Void in
+        if let object = type.importObjectWithData(ObjectJSONValue(element), context: importContext) {
+          importedObjects.append(object)
+        }
+      }
+
       let json: JSONValue?
       if hasOption(LogFlags.Preparsed, logFlags) {
         let preparsedString = JSONSerialization.stringByParsingDirectivesForFile(path, options: .InflateKeypaths, error: &error)
@@ -298,38 +311,90 @@ import MoonKit
         } else {
           json = nil
         }
-      } else {
+      } else if hasOption(LogFlags.Parsed, logFlags) {
         json = JSONSerialization.objectByParsingFile(path, options: .InflateKeypaths, error: &error)
+      } else {
+        json = JSONSerialization.objectByParsingFile(path, options: .InflateKeypaths, error: &error, elementHandler: importElement)
       }
 
       if MSHandleError(error) == false && json != nil
       {
         if hasOption(LogFlags.Parsed, logFlags) { MSLogDebug("json objects from parsed file:\n\(json)") }
+        self.importJSON(json!, forModel: type, context: importContext, logFlags: logFlags, path: path, importedObjects: importedObjects)
+        if importContext.hasChanges && !importContext.save(&error) {
+          MSHandleError(error, message: "failed to save objects imported from file '\(path)'")
+        }
+      } else { MSLogError("failed to parse file '\(path)', nothing has been imported") }
 
-        if let data = ObjectJSONValue(json), importedObject = type(data: data, context: context) {
+    }
+    completion?(error == nil, error)
+  }
 
-          MSLogDebug("imported \(type.className()) from file '\(path)'")
+  /**
+  Imports the objects of a parsed file into `context`
 
-          if hasOption(LogFlags.Imported, logFlags) {
-            MSLogDebug("json output for imported object:\n\(importedObject.jsonValue)")
-          }
+  :param: json JSONValue
+  :param: type T.Type
+  :param: context NSManagedObjectContext
+  :param: logFlags LogFlags
+  :param: path String The file's path for logging
+  :param: importedObjects [ModelObject] = [] Objects already imported from the file's elements
+  */
+  private class func importJSON<T:ModelObject>(json: JSONValue,
+                                      forModel type: T.Type,
+                                       context: NSManagedObjectContext,
+                                      logFlags: LogFlags,
+                                          path: String,
+                           var importedObjects: [ModelObject] = [])
+  {
+    if let data = ObjectJSONValue(json), importedObject = type(data: data, context: context) {
 
-        } else if let data = ArrayJSONValue(json) {
+      MSLogDebug("imported \(type.className()) from file '\(path)'")
 
-          let importedObjects = type.importObjectsWithData(data, context: context)
+      if hasOption(LogFlags.Imported, logFlags) {
+        MSLogDebug("json output for imported object:\n\(importedObject.jsonValue)")
+      }
 
-          MSLogDebug("\(importedObjects.count) \(type.className()) objects imported from file '\(path)'")
+    } else if let data = ArrayJSONValue(json) {
 
-          if hasOption(LogFlags.Imported, logFlags) {
-            MSLogDebug("json output for imported object:\n\(JSONValue.Array(importedObjects.map({$0.jsonValue})).prettyRawValue)")
-          }
+      importedObjects += type.importObjectsWithData(data, context: context)
+      logImportedObjects(importedObjects, forModel: type, logFlags: logFlags, path: path)
 
-        } else { MSLogError("file content must resolve into [String:AnyObject] or [[String:AnyObject]]") }
+    } else { MSLogError("file content must resolve into [String:AnyObject] or [[String:AnyObject]]") }
+  }
 
-      } else { MSLogError("failed to parse file '\(path)'") }
+  /**
+  Logs the objects imported from the elements of a file's root array
 
+  :param: importedObjects [ModelObject]
+  :param: type ModelObject.Type
+  :param: logFlags LogFlags
+  :param: path String The file's path for logging
+  */
+  private class func logImportedObjects(importedObjects: [ModelObject],
+                               forModel type: ModelObject.Type,
+                                    logFlags: LogFlags,
+                                        path: String)
+  {
+    MSLogDebug("\(importedObjects.count) \(type.className()) objects imported from file '\(path)'")
+
+    if hasOption(LogFlags.Imported, logFlags) {
+      MSLogDebug("json output for imported object:\n\(JSONValue.Array(importedObjects.map({$0.jsonValue})).prettyRawValue)")
     }
-    completion?(error == nil, error)
+  }
+
+  /**
+  Resolves `name` into the path of a json file in the data model or main bundle unless it is already an absolute path
+
+  :param: name String
+
+  :returns: String?
+  */
+  private class func pathForJSONFileNamed(var name: String) -> String? {
+    if name.hasPrefix("/") && name.hasSuffix(".json") { return name }
+    if name.hasSuffix(".json") { name = name.stringByDeletingPathExtension }
+    if let path = dataModelBundle.pathForResource(name, ofType: "json") { return path }
+    else { return NSBundle.mainBundle().pathForResource(name, ofType: "json") }
   }
 
   /**
@@ -341,68 +406,151 @@ import MoonKit
   :param: logFlags LogFlags = .Default
   :param: completion ((Bool, NSError?) -> Void)? = nil
   */
-  public class func loadJSONFileNamed<T:ModelObject>(var name: String,
+  public class func loadJSONFileNamed<T:ModelObject>(name: String,
                                              forModel type: T.Type,
                                              context: NSManagedObjectContext,
                                             logFlags: LogFlags = .Default,
                                           completion: ((Bool, NSError?) -> Void)? = nil)
   {
+    if let path = pathForJSONFileNamed(name) {
+      loadJSONFileAtPath(path, forModel: type, context: context, logFlags: logFlags, completion: completion)
+    } else {
+      MSLogError("unable to resolve the name '\(name)' into a bundled file path")
+      completion?(false, NSError(domain: NSCocoaErrorDomain, code: NSFileNoSuchFileError, userInfo: nil))
+    }
+  }
+
+  /** Directory for the `JSONSnapshot` of each file loaded by `loadData`, rewritten whenever a file's text changes */
+  private static let snapshotDirectory: String? = {
+    let fileManager = NSFileManager.defaultManager()
     var error: NSError?
-    var path: String?
+    if let cachesDirectoryURL = fileManager.URLForDirectory(.CachesDirectory,
+                                                   inDomain: .UserDomainMask,
+                                          appropriateForURL: nil,
+                                                     create: true,
+                                                      error: &error)
+      where !MSHandleError(error, message: "failed to retrieve caches directory"),
+      let path = cachesDirectoryURL.URLByAppendingPathComponent("JSONSnapshots").path
+      where fileManager.createDirectoryAtPath(path, withIntermediateDirectories: true, attributes: nil, error: &error)
+        && !MSHandleError(error, message: "failed to create directory for json snapshots")
+    {
+      return path
+    } else { return nil }
+  }()
 
-    // Check if we are given an absolute path
-    if name.hasPrefix("/") && name.hasSuffix(".json") { path = name }
+  /** A file named by the markers of a model flag along with its parsed content and the context it is imported into */
+  private final class ModelFile {
+    let flag: ModelFlag
+    let path: String?
+    let context: NSManagedObjectContext
+    var logFlags = LogFlags.Default
+    var removeExisting = false
+    var document: JSONDocument?
 
-    // Otherwise, treat as a bundle resource
-    else {
-      if name.hasSuffix(".json") { name = name.stringByDeletingPathExtension }
-      if let p = self.dataModelBundle.pathForResource(name, ofType: "json") { path = p }
-      else if let p = NSBundle.mainBundle().pathForResource(name, ofType: "json") { path = p }
-      else {
-        MSLogError("unable to resolve the name '\(name)' into a bundled file path")
-        error = NSError(domain: NSCocoaErrorDomain, code: NSFileNoSuchFileError, userInfo: nil)
+    /**
+    initWithFlag:context:
+
+    :param: flag ModelFlag
+    :param: context NSManagedObjectContext
+    */
+    init(flag: ModelFlag, context: NSManagedObjectContext) {
+      self.flag = flag
+      self.context = context
+      var fileName: String?
+      for marker in flag.markers {
+        switch marker {
+          case .Remove: removeExisting = true
+          case .LoadFile(let f): fileName = f
+          case .Log(let values):
+            if values ∋ .Parsed { logFlags |= LogFlags.Parsed }
+            if values ∋ .Imported { logFlags |= LogFlags.Imported }
+            if values ∋ .File { logFlags |= LogFlags.File }
+          default: break
+        }
       }
+      if let name = fileName {
+        path = DataManager.pathForJSONFileNamed(name)
+        if path == nil { MSLogError("unable to resolve the name '\(name)' into a bundled file path") }
+      } else { path = nil }
     }
 
-    if path != nil { loadJSONFileAtPath(path!, forModel: type, context: context, logFlags: logFlags, completion: completion) }
-    else { completion?(false, error) }
+    /** Reads and parses the file or its snapshot, touches no context */
+    func parse() {
+      if let path = path {
+        if hasOption(LogFlags.File, logFlags),
+          let contents = String(contentsOfFile: path, encoding: NSUTF8StringEncoding, error: nil)
+        {
+          MSLogDebug("content of file to parse:\n\(contents)")
+        }
+        var error: NSError?
+        // Unchanged files are read from their snapshots rather than parsed again
+        if let directory = DataManager.snapshotDirectory {
+          let snapshotPath = directory.stringByAppendingPathComponent(path.lastPathComponent + "b")
+          document = JSONSerialization.documentByParsingFile(path,
+                                                     options: .InflateKeypaths,
+                                                snapshotPath: snapshotPath,
+                                                       error: &error)
+        } else {
+          document = JSONSerialization.documentByParsingFile(path, options: .InflateKeypaths, error: &error)
+        }
+        if MSHandleError(error, message: "failed to parse file '\(path)'") { document = nil }
+        else if hasOption(LogFlags.Parsed, logFlags) {
+          MSLogDebug("json objects from parsed file:\n\(document?.root.jsonValue)")
+        }
+      }
+    }
+
+    /** Imports the parsed content into `context` and saves it into the root context */
+    func importContent() {
+      context.performBlockAndWait {
+        if self.removeExisting { self.context.deleteObjects(Set(self.flag.modelType.objectsInContext(self.context))) }
+        if let root = self.document?.root, path = self.path {
+          let type = self.flag.modelType
+          if root.kind == .Array {
+            // Elements are converted one at a time so only the document's arena and a single element tree are held
+            var importedObjects: [ModelObject] = []
+            for element in root.children {
+              if let object = type.importObjectWithData(ObjectJSONValue(element), context: self.context) {
+                importedObjects.append(object)
+              }
+            }
+            DataManager.logImportedObjects(importedObjects, forModel: type, logFlags: self.logFlags, path: path)
+          } else {
+            DataManager.importJSON(root.jsonValue, forModel: type, context: self.context, logFlags: self.logFlags, path: path)
+          }
+        }
+        var error: NSError?
+        if self.context.hasChanges && !self.context.save(&error) {
+          MSHandleError(error, message: "failed to save objects imported for '\(self.flag.rawValue)'")
+        }
+      }
+    }
   }
 
   /**
-  Load data from files parsed from command line arguments and save the root context
+  Load data from files parsed from command line arguments and save the root context. Every file is parsed at once on
+  background queues. Each is then imported into its own child of the root context, files of one import stage at the same
+  time, and the root context is saved once all stages have been merged into it.
 
   :param: completion ((Bool, NSError?) -> Void)? = nil
   */
   private class func loadData(completion: ((Bool, NSError?) -> Void)? = nil) {
 
-    rootContext.performBlock {[rootContext = self.rootContext] in
+    let files = modelFlags.map { ModelFile(flag: $0, context: self.stack.privateContext()) }
+    let queue = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH, 0)
 
-      self.modelFlags ➤ {
-        var fileName: String?
-        var logFlags = LogFlags.Default
-        var logFile = false
-        var logParsed = false
-        var logImported = false
-        var removeExisting = false
-        for marker in $0.markers {
-          switch marker {
-            case .Remove: removeExisting = true
-            case .LoadFile(let f): fileName = f
-            case .Log(let values):
-              if values ∋ .Parsed { logFlags |= LogFlags.Parsed }
-              if values ∋ .Imported { logFlags |= LogFlags.Imported }
-              if values ∋ .File { logFlags |= LogFlags.File }
-          default: break
-          }
-        }
-        if removeExisting { rootContext.deleteObjects(Set($0.modelType.objectsInContext(rootContext))) }
-        if fileName != nil {
-          self.loadJSONFileNamed(fileName!, forModel: $0.modelType, context: rootContext, logFlags: logFlags)
-        }
+    dispatch_async(queue) {
+
+      dispatch_apply(files.count, queue) { files[$0].parse() }
+
+      // Each stage only references objects that earlier stages have saved into the root context
+      for stage in sorted(Set(files.map({$0.flag.importStage}))) {
+        let stageFiles = files.filter { $0.flag.importStage == stage }
+        dispatch_apply(stageFiles.count, queue) { stageFiles[$0].importContent() }
       }
-    }
 
-    saveRootContext(completion: completion)
+      self.saveRootContext(completion: completion)
+    }
 
   }
 
@@ -425,9 +573,11 @@ import MoonKit
   }
 
   /**
-  dumpJSONForModelType:
+  Writes the JSON for every object of `modelType` to '<class name>.json' in the documents directory, one object at a
+  time so that large tables never exist as a single string
 
   :param: modelType ModelObject.Type
+  :param: context NSManagedObjectContext = rootContext
   */
   public class func dumpJSONForModelType(modelType: ModelObject.Type, context: NSManagedObjectContext = rootContext) {
     let className = (modelType.self as AnyObject).className
@@ -439,8 +589,17 @@ import MoonKit
       objects = modelType.objectsInContext(context)
     }
     if objects.isEmpty { MSLogWarn("fetch turned up empty for '\(modelType)'") }
-    let json: JSONValue = .Array(objects.map({$0.jsonValue}))
-    MSLogDebug("\(className) objects: \n\(json.prettyRawValue)\n")
+    if let path = MoonFunctions.documentsPathToFile("\(className).json"),
+      writer = JSONWriter.writerForFileAtPath(path, options: JSONSerialization.WriteOptions.Prettified)
+    {
+      writer.beginArray()
+      for object in objects { writer.writeValue(object.jsonValue) }
+      writer.endArray()
+      writer.close()
+      if !MSHandleError(writer.error, message: "failed to dump '\(className)' objects") {
+        MSLogDebug("\(objects.count) \(className) objects written to '\(path)'")
+      }
+    } else { MSLogError("unable to open file to dump '\(className)' objects") }
   }
 
   // MARK: - Data stack related accessors and methods
@@ -810,6 +969,23 @@ import MoonKit
       }
     }
 
+    /** The flags whose objects may be referenced by index from the flag's file, they must be imported first */
+    var dependencies: [ModelFlag] {
+      switch self {
+      case .Manufacturers, .Images, .NetworkDevices: return []
+      case .ComponentDevices:                         return [.Manufacturers]
+      case .Presets:                                  return [.Images]
+      case .Activities:                               return [.Manufacturers, .ComponentDevices, .Images]
+      case .Remotes:                                  return [.Manufacturers, .ComponentDevices, .Images, .Activities,
+                                                              .NetworkDevices, .Presets]
+      case .Controller:                               return [.Manufacturers, .ComponentDevices, .Images, .Activities,
+                                                              .NetworkDevices, .Presets, .Remotes]
+      }
+    }
+
+    /** One more than the deepest stage of the flag's dependencies, flags sharing a stage may be imported together */
+    var importStage: Int { return dependencies.isEmpty ? 0 : maxElement(dependencies.map({$0.importStage})) + 1 }
+
     /** An array of all possible flag keys for which an argument has been passed */
     static public var all: [ModelFlag] = [.Manufacturers, .ComponentDevices, .Images, .Activities,
                                    .NetworkDevices, .Presets, .Remotes, .Controller].filter {
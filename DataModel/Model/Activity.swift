@@ -48,15 +48,18 @@ public final class Activity: IndexedModelObject {
   }
 
   /**
-  Halts the activity by invoking the halt macro and switching to the home remote.
+  Halts the activity by invoking the halt macro and switching to the home remote. A launch still in progress is
+  cancelled first.
 
   :param: completion Block to execute upon completing the task
   */
   public func haltActivity(completion: ((success: Bool, error: NSError?) -> Void)?) {
-    if let controller = activityController where controller.currentActivity == self, let macro = haltMacro {
+    let launching = launchMacro?.executing == true
+    if launching { launchMacro?.cancel() }
+    if let controller = activityController where controller.currentActivity == self || launching, let macro = haltMacro {
       macro.execute {[unowned self] (success, error) -> Void in
         if error == nil && success {
-          controller.currentActivity = nil
+          if controller.currentActivity == self { controller.currentActivity = nil }
           completion?(success: controller.currentRemote == controller.homeRemote, error: nil)
         } else {
           completion?(success: false, error: error)
@@ -72,7 +75,9 @@ public final class Activity: IndexedModelObject {
   */
   public func launchOrHaltActivity(completion: ((success: Bool, error: NSError?) -> Void)?) {
     if let controller = activityController {
-      if let currentActivity = controller.currentActivity {
+      if launchMacro?.executing == true {
+        haltActivity(completion)
+      } else if let currentActivity = controller.currentActivity {
         if currentActivity == self {
           haltActivity(completion)
         } else {
@@ -33,6 +33,14 @@ public final class MacroCommand: Command {
   public var count: Int { return commands.count }
   public let queue = NSOperationQueue(name: "com.moondeerstudios.macro")
 
+  /** Whether commands from an execution of the macro are still running or waiting to run */
+  public var executing: Bool { return queue.operationCount > 0 }
+
+  /** Cancels any execution in progress, pending delays end early and commands yet to run are skipped */
+  public func cancel() {
+    for operation in queue.operations { if let operation = operation as? CommandOperation { operation.cancel() } }
+  }
+
   override var operation: CommandOperation { return MacroCommandOperation(command: self) }
 
   override public var indicator: Bool { return true }
@@ -12,5 +12,13 @@ import MoonKit
 
 @objc(SendCommand)
 public class SendCommand: Command {
+
+  /**
+  Delivers a command to its device, the data model cannot reach the network itself so the networking layer installs
+  the sender. It receives the command's object ID, whether a macro is sending it, and the block to invoke with the
+  result. Without a sender every send fails.
+  */
+  public static var sender: ((NSManagedObjectID, Bool, (Bool, NSError?) -> Void) -> Void)?
+
   override var operation: CommandOperation { return SendCommandOperation(command: self) }
 }
\ No newline at end of file
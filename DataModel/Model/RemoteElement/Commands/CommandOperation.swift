@@ -31,13 +31,20 @@ internal class CommandOperation: NSOperation {
       didChangeValueForKey("isFinished")
     }
   }
+  /** Subclasses record the outcome before calling `super.main()`, which is what marks the operation finished */
   private(set) var success: Bool = false {
-    didSet { if success && (error != nil || !finished || cancelled) { success = false } }
+    didSet { if success && (error != nil || cancelled) { success = false } }
   }
   override var concurrent: Bool { return true }
   let command: Command
+
+  /** Queue on which every operation's `main` runs, so that executing a command never spawns a thread of its own */
+  static let executionQueue = dispatch_queue_create("com.moondeerstudios.command-execution", DISPATCH_QUEUE_CONCURRENT)
   private(set) var error: NSError?
 
+  /** Whether the operation is one of the commands of a macro */
+  var isMacroStep = false
+
   /**
   initWithCommand:
 
@@ -59,8 +66,8 @@ internal class CommandOperation: NSOperation {
       error = unsuccessfulDependency.error
       finished = true
     } else {
-      NSThread.detachNewThreadSelector("main", toTarget: self, withObject: nil)
       executing = true
+      dispatch_async(CommandOperation.executionQueue) { self.main() }
     }
   }
 
@@ -121,54 +128,169 @@ final class SendCommandOperation: CommandOperation {
   /** main */
   override func main() {
     let commandID = command.objectID
-//    ConnectionManager.sendCommandWithID(commandID) {
-//      MSLogDebug("command ID:\(commandID)\ncompletion: success? \($0) error - \($1)")
-//      self.success = $0
-//      self.error = $1
-//      super.main()
-//    }
+    if let sender = SendCommand.sender {
+      sender(commandID, isMacroStep) {
+        MSLogDebug("command ID:\(commandID)\ncompletion: success? \($0) error - \($1)")
+        self.error = $1
+        self.success = $0
+        super.main()
+      }
+    } else {
+      MSLogError("no sender installed for command ID:\(commandID)")
+      success = false
+      super.main()
+    }
   }
 
 }
 
+/**
+Waits out a `DelayCommand` on a dispatch timer rather than a sleeping thread. Cancelling the operation ends the wait
+early. Delays of the same duration waiting on the same device share a single timer.
+*/
 final class DelayCommandOperation: CommandOperation {
 
+  /** Identifies the device whose warm-up the delay waits on, delays without one are never coalesced */
+  var warmUpKey: String?
+
   /** main */
   override func main() {
     if let delayCommand = command as? DelayCommand {
-      NSThread.sleepForTimeInterval(Double(delayCommand.duration))
-      success = true
-      super.main()
+      DelayTimer.addOperation(self, duration: Double(delayCommand.duration)) {
+        self.success = true
+        super.main()
+      }
     } else {
       success = false
       super.main()
     }
   }
 
+  /** cancel */
+  override func cancel() {
+    super.cancel()
+    if DelayTimer.removeOperation(self) { super.main() }
+  }
+
+}
+
+/** A dispatch timer shared by the delay operations waiting on it */
+private final class DelayTimer {
+
+  /** Serializes access to the timers and their waiting operations, timer events are delivered here as well */
+  static let queue = dispatch_queue_create("com.moondeerstudios.delay", DISPATCH_QUEUE_SERIAL)
+
+  /** Pending timers that may be joined keyed by warm-up key and duration */
+  static var sharedTimers: [String:DelayTimer] = [:]
+
+  /** Timers keyed by the identifier of each operation waiting on them */
+  static var timersByOperation: [ObjectIdentifier:DelayTimer] = [:]
+
+  let sharingKey: String?
+  let source: dispatch_source_t
+  var handlers: [ObjectIdentifier:() -> Void] = [:]
+
+  /**
+  initWithDuration:sharingKey:
+
+  :param: duration Double
+  :param: sharingKey String?
+  */
+  init(duration: Double, sharingKey: String?) {
+    self.sharingKey = sharingKey
+    source = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, DelayTimer.queue)
+    let start = dispatch_time(DISPATCH_TIME_NOW, Int64(duration * Double(NSEC_PER_SEC)))
+    dispatch_source_set_timer(source, start, DISPATCH_TIME_FOREVER, NSEC_PER_SEC / 100)
+    dispatch_source_set_event_handler(source) { [unowned self] in self.fire() }
+    dispatch_resume(source)
+  }
+
+  /**
+  Registers `handler` to run once `duration` seconds have passed, joining a pending timer for the same warm-up
+
+  :param: operation DelayCommandOperation
+  :param: duration Double
+  :param: handler () -> Void
+  */
+  static func addOperation(operation: DelayCommandOperation, duration: Double, handler: () -> Void) {
+    dispatch_sync(queue) {
+      let sharingKey: String? = operation.warmUpKey == nil ? nil : "\(operation.warmUpKey!)|\(duration)"
+      let timer: DelayTimer
+      if let key = sharingKey, sharedTimer = DelayTimer.sharedTimers[key] {
+        MSLogDebug("coalescing delay with pending timer for '\(key)'")
+        timer = sharedTimer
+      } else {
+        timer = DelayTimer(duration: duration, sharingKey: sharingKey)
+        if let key = sharingKey { DelayTimer.sharedTimers[key] = timer }
+      }
+      timer.handlers[ObjectIdentifier(operation)] = handler
+      DelayTimer.timersByOperation[ObjectIdentifier(operation)] = timer
+    }
+  }
+
+  /**
+  Stops `operation` waiting on its timer, the timer itself is cancelled once nothing waits on it
+
+  :param: operation DelayCommandOperation
+
+  :returns: Bool Whether the operation was still waiting
+  */
+  static func removeOperation(operation: DelayCommandOperation) -> Bool {
+    var removed = false
+    dispatch_sync(queue) {
+      if let timer = DelayTimer.timersByOperation.removeValueForKey(ObjectIdentifier(operation)) {
+        timer.handlers.removeValueForKey(ObjectIdentifier(operation))
+        if timer.handlers.isEmpty { timer.invalidate() }
+        removed = true
+      }
+    }
+    return removed
+  }
+
+  /** Cancels the dispatch source and withdraws the timer from sharing */
+  func invalidate() {
+    dispatch_source_cancel(source)
+    if let key = sharingKey where DelayTimer.sharedTimers[key] === self { DelayTimer.sharedTimers[key] = nil }
+  }
+
+  /** Hands every waiting operation back to the execution queue */
+  func fire() {
+    invalidate()
+    for (identifier, handler) in handlers {
+      DelayTimer.timersByOperation[identifier] = nil
+      dispatch_async(CommandOperation.executionQueue, handler)
+    }
+    handlers.removeAll()
+  }
+
 }
 
+/**
+Runs the commands of a macro as a dependency graph rather than a chain. Commands that address the same device (the same
+iTach port or http host) keep their order relative to one another while commands for different devices run
+concurrently. Any other command, a `DelayCommand` for instance, is a barrier that waits on everything before it and that
+everything after it waits on. A command that fails stops the commands depending on it.
+*/
 final class MacroCommandOperation: CommandOperation {
 
   /** main */
   override func main() {
-    // TODO: Make sure execution stops on first unsuccessful command in the macro
     if let macroCommand = command as? MacroCommand {
       if macroCommand.commands.count > 0 {
         let operations = macroCommand.commands.map {$0.operation}
-        var precedingOperation: CommandOperation?
-        for operation in operations {
-          if precedingOperation != nil { operation.addDependency(precedingOperation!) }
-          precedingOperation = operation
-        }
-        precedingOperation?.completionBlock = {
+        apply(operations) { $0.isMacroStep = true }
+        MacroCommandOperation.addDependenciesToOperations(operations)
+        let completion = NSBlockOperation {
           MSLogDebug("command dispatch complete")
-          self.success = findFirst(operations, {$0.finished && !$0.success}) == nil
           let errors = compressedMap(operations, {$0.error})
           if errors.count == 1 { self.error = errors.last }
           else if errors.count > 1 { self.error = NSError(domain: "MacroCommandExecution", code: -1, underlyingErrors: errors) }
+          self.success = findFirst(operations, {$0.finished && !$0.success}) == nil
           super.main()
         }
+        apply(operations) { completion.addDependency($0) }
         macroCommand.queue.addOperations((operations as NSOrderedSet).array, waitUntilFinished: false)
+        macroCommand.queue.addOperation(completion)
       } else {
         success = true
         super.main()
@@ -179,6 +301,65 @@ final class MacroCommandOperation: CommandOperation {
     }
   }
 
+  /** cancel */
+  override func cancel() {
+    super.cancel()
+    (command as? MacroCommand)?.cancel()
+  }
+
+  /**
+  Links each operation to the last operation for the same device, or to the last barrier when it is the first for its
+  device, and links each barrier to every operation since the previous barrier
+
+  :param: operations OrderedSet<CommandOperation>
+  */
+  private static func addDependenciesToOperations(operations: OrderedSet<CommandOperation>) {
+    var barrier: CommandOperation?
+    var lastOperationForKey: [String:CommandOperation] = [:]
+    var operationsSinceBarrier: [CommandOperation] = []
+
+    for operation in operations {
+      if let key = schedulingKeyForCommand(operation.command) {
+        if let preceding = lastOperationForKey[key] ?? barrier { operation.addDependency(preceding) }
+        lastOperationForKey[key] = operation
+        operationsSinceBarrier.append(operation)
+      } else {
+        // A delay following device commands is taken to wait on the last of those devices warming up
+        if let delayOperation = operation as? DelayCommandOperation, preceding = operationsSinceBarrier.last {
+          delayOperation.warmUpKey = schedulingKeyForCommand(preceding.command)
+        }
+        if operationsSinceBarrier.isEmpty { if let preceding = barrier { operation.addDependency(preceding) } }
+        else { apply(operationsSinceBarrier) { operation.addDependency($0) } }
+        barrier = operation
+        lastOperationForKey.removeAll(keepCapacity: true)
+        operationsSinceBarrier.removeAll(keepCapacity: true)
+      }
+    }
+  }
+
+  /**
+  Identifies the device a command is sent to, `nil` for commands that must act as barriers
+
+  :param: command Command
+
+  :returns: String?
+  */
+  private static func schedulingKeyForCommand(command: Command) -> String? {
+    switch command {
+      case let irCommand as ITachIRCommand:
+        if let componentDevice = irCommand.componentDevice {
+          // Codes on the same port share an emitter, devices on different ports do not
+          if let networkDevice = componentDevice.networkDevice {
+            return "\(networkDevice.uniqueIdentifier):\(componentDevice.port)"
+          } else { return componentDevice.uuid }
+        } else { return nil }
+      case let httpCommand as HTTPCommand:
+        return httpCommand.url.host
+      default:
+        return nil
+    }
+  }
+
 }
 
 final class SystemCommandOperation: CommandOperation {
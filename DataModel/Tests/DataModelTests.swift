@@ -650,6 +650,129 @@ class DataModelTests: QuickSpec {
       }
     }
 
+    describe("command dispatch") {
+      it("runs a macro of zero length delays without a thread per command") {
+        let commandCount = 1000
+        let macro = MacroCommand(context: moc)
+        var delays: [Command] = []
+        for _ in 0 ..< commandCount { let delay = DelayCommand(context: moc); delay.duration = 0; delays.append(delay) }
+        macro.commands = OrderedSet(delays)
+
+        var succeeded: Bool?
+        macro.execute { success, _ in succeeded = success }
+        expect(succeeded).toEventually(beTrue(), timeout: 10)
+        moc.deleteObject(macro)
+        apply(delays) { moc.deleteObject($0) }
+      }
+    }
+
+    describe("macro scheduling") {
+      var installedSender: ((NSManagedObjectID, Bool, (Bool, NSError?) -> Void) -> Void)?
+      var names: [NSManagedObjectID:String] = [:]
+      var events: [String] = []
+      let eventQueue = dispatch_queue_create("com.moondeerstudios.tests.macro-scheduling", DISPATCH_QUEUE_SERIAL)
+
+      // Each send is recorded as '+name' when it starts and '-name' once it completes 50ms later
+      beforeEach {
+        names = [:]
+        events = []
+        installedSender = SendCommand.sender
+        SendCommand.sender = {
+          commandID, _, completion in
+          dispatch_sync(eventQueue) { events.append("+" + (names[commandID] ?? "?")) }
+          let time = dispatch_time(DISPATCH_TIME_NOW, Int64(0.05 * Double(NSEC_PER_SEC)))
+          dispatch_after(time, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0)) {
+            dispatch_sync(eventQueue) { events.append("-" + (names[commandID] ?? "?")) }
+            completion(true, nil)
+          }
+        }
+      }
+
+      afterEach { SendCommand.sender = installedSender }
+
+      // Runs a macro of http commands named by host and number, 'a1' goes to host 'a', and delays named 'delay'.
+      // Returns the events recorded by the sender.
+      let run: ([String]) -> [String] = {
+        commandNames in
+        let macro = MacroCommand(context: moc)
+        var commands: [Command] = []
+        for name in commandNames {
+          if name == "delay" {
+            let delay = DelayCommand(context: moc)
+            delay.duration = 0
+            commands.append(delay)
+          } else {
+            let command = HTTPCommand(context: moc)
+            command.url = NSURL(string: "http://\(name[0..<1])/rest/\(name)")!
+            names[command.objectID] = name
+            commands.append(command)
+          }
+        }
+        macro.commands = OrderedSet(commands)
+
+        var succeeded: Bool?
+        macro.execute { success, _ in succeeded = success }
+        expect(succeeded).toEventually(beTrue(), timeout: 5)
+        moc.deleteObject(macro)
+        apply(commands) { moc.deleteObject($0) }
+        var recorded: [String] = []
+        dispatch_sync(eventQueue) { recorded = events }
+        return recorded
+      }
+
+      it("runs commands for different devices concurrently") {
+        let recorded = run(["a1", "b1"])
+        expect(recorded.count) == 4
+        expect(Set(recorded[0 ..< 2])) == Set(["+a1", "+b1"])
+      }
+
+      it("keeps the order of commands for the same device") {
+        let recorded = run(["a1", "a2", "b1"])
+        let index: (String) -> Int = { find(recorded, $0) ?? -1 }
+        expect(recorded.count) == 6
+        expect(index("-a1")) < index("+a2")
+        expect(index("+b1")) < index("-a1")
+      }
+
+      it("treats delays as barriers") {
+        let recorded = run(["a1", "b1", "delay", "a2"])
+        let index: (String) -> Int = { find(recorded, $0) ?? -1 }
+        expect(recorded.count) == 6
+        expect(index("-a1")) < index("+a2")
+        expect(index("-b1")) < index("+a2")
+      }
+    }
+
+  }
+
+}
+
+/** Measures the overhead of dispatching commands, apart from the time any command takes to do its work */
+class CommandDispatchPerformanceTests: XCTestCase {
+
+  /** Number of zero length delays in the measured macro, the measured time divided by this is the cost per command */
+  static let commandCount = 1000
+
+  func testZeroLengthDelayDispatchPerformance() {
+    let moc = DataManager.isolatedContext()
+    let macro = MacroCommand(context: moc)
+    var delays: [Command] = []
+    for _ in 0 ..< self.dynamicType.commandCount {
+      let delay = DelayCommand(context: moc)
+      delay.duration = 0
+      delays.append(delay)
+    }
+    macro.commands = OrderedSet(delays)
+
+    measureBlock {
+      let expectation = self.expectationWithDescription("macro finished")
+      macro.execute {
+        success, _ in
+        XCTAssert(success)
+        expectation.fulfill()
+      }
+      self.waitForExpectationsWithTimeout(10, handler: nil)
+    }
   }
 
 }
@@ -259,6 +259,24 @@ class MoonKit_Tests: XCTestCase {
     } else { XCTFail("could not get file path for 'Preset.json'") }
   }
 
+  func testJSONSerialization_DirectiveInvalidation() {
+    let fileManager = NSFileManager.defaultManager()
+    let directory = NSTemporaryDirectory().stringByAppendingPathComponent(NSUUID().UUIDString)
+    fileManager.createDirectoryAtPath(directory, withIntermediateDirectories: true, attributes: nil, error: nil)
+    let rootPath = directory.stringByAppendingPathComponent("root.json")
+    let includePath = directory.stringByAppendingPathComponent("include.json")
+    "{\"key\": <@include include.json,VALUE=1>}".writeToFile(rootPath, atomically: true, encoding: NSUTF8StringEncoding, error: nil)
+
+    "[<#VALUE#>]".writeToFile(includePath, atomically: true, encoding: NSUTF8StringEncoding, error: nil)
+    XCTAssertEqual(JSONSerialization.stringByParsingDirectivesForFile(rootPath) ?? "", "{\"key\": [1]}")
+
+    "[<#VALUE#>, 2]".writeToFile(includePath, atomically: true, encoding: NSUTF8StringEncoding, error: nil)
+    fileManager.setAttributes([NSFileModificationDate: NSDate(timeIntervalSinceNow: 60)], ofItemAtPath: includePath, error: nil)
+    XCTAssertEqual(JSONSerialization.stringByParsingDirectivesForFile(rootPath) ?? "", "{\"key\": [1, 2]}")
+
+    fileManager.removeItemAtPath(directory, error: nil)
+  }
+
   func testJSONParser() {
 
     func parserTest(string: String, allowFragment: Bool, ignoreExcess: Bool, expectToFail: Bool) {
@@ -283,6 +301,83 @@ class MoonKit_Tests: XCTestCase {
     parserTest("42", true, false, false)
     parserTest("{\"key\":\"value\"}", true, false, false)
     parserTest("[1,2,3]", true, false, false)
+    parserTest("{}", false, false, false)
+    parserTest("[1,2,3] // comment", false, false, false)
+    parserTest("[1,2,3] /* open-ended", false, false, true)
+    parserTest("[1,2,3] excess", false, false, true)
+    parserTest("[1,2,3] excess", false, true, false)
+  }
+
+  func testJSONParserElementHandler() {
+    var elements: [String] = []
+    let builder = JSONValueBuilder(elementHandler: { elements.append($0.rawValue) })
+    var error: NSError?
+    XCTAssert(JSONParser(string: "[{\"key\":[1,2]},\"value\",null]").parse(delegate: builder, error: &error))
+    XCTAssertFalse(MSHandleError(error))
+    XCTAssert(elements == ["{\"key\":[1,2]}", "\"value\"", "null"], "unexpected elements")
+    XCTAssert(builder.value?.rawValue == "[]", "elements should not be retained by the root array")
+  }
+
+  func testJSONWriter() {
+    if let value = JSONValue(rawValue: "{\"empty\":{},\"list\":[1,[]],\"nested\":{\"key\":\"value\"}}") {
+      XCTAssertEqual(JSONWriter.stringWithValue(value), value.rawValue)
+      XCTAssertEqual(value.prettyRawValue,
+        "{\n    \"empty\": {},\n    \"list\": [\n        1,\n        []\n    ],\n    \"nested\": {\n        \"key\": \"value\"\n    }\n}")
+      let options = JSONSerialization.WriteOptions.CreateKeypaths | JSONSerialization.WriteOptions.ForceOneLiners
+      XCTAssertEqual(JSONWriter.stringWithValue(value, options: options),
+                     "{\"empty\":{},\"list\":[1,[]],\"nested.key\":\"value\"}")
+    } else { XCTFail("failed to parse value for writer") }
+  }
+
+  func testJSONSnapshot() {
+    if let value = JSONValue(rawValue: "[{\"name\":\"a\",\"index\":1},{\"name\":\"b\",\"index\":2.5,\"on\":true},null,[]]") {
+      let data = JSONSnapshot.dataWithValue(value, sourceHash: 42)
+      var error: NSError?
+      let snapshot = JSONSnapshot(data: data, error: &error)
+      XCTAssertFalse(MSHandleError(error))
+      XCTAssertEqual(snapshot?.sourceHash ?? 0, UInt64(42))
+      if let decoded = snapshot?.value(error: &error) { XCTAssertEqual(decoded, value) }
+      else { XCTFail("failed to decode snapshot: \(error)") }
+      XCTAssertNil(JSONSnapshot(data: data.subdataWithRange(NSRange(location: 0, length: 12))))
+    } else { XCTFail("failed to parse value for snapshot") }
+  }
+
+  func testJSONDocument() {
+    let string = "[{\"name\":\"a\",\"index\":1},{\"name\":\"b\",\"index\":2,\"on\":true},{\"color.red\":1}]"
+    if let data = string.dataUsingEncoding(NSUTF8StringEncoding),
+      document = JSONDocument(data: data, options: .InflateKeypaths),
+      value = JSONValue(rawValue: string)
+    {
+      XCTAssert(document.keys == ["name", "index", "on", "color.red"], "keys should be interned once")
+      XCTAssertEqual(document.root.count, 3)
+      XCTAssertEqual(document.root[1]?["name"]?.stringValue ?? "", "b")
+      XCTAssert(document.root[1]?["on"]?.boolValue == true)
+      XCTAssertNil(document.root[0]?["on"])
+      XCTAssertEqual(document.root[0]!.jsonValue, value[0]!)
+      XCTAssertEqual(document.root.jsonValue, value.inflatedValue)
+      XCTAssertNotNil(ObjectJSONValue(document.root[2]!)?["color"])
+      XCTAssertNil(ArrayJSONValue(document.root[2]!))
+    } else { XCTFail("failed to parse document") }
+  }
+
+  func testJSONParserPerformance() {
+    if let bundlePath = NSUserDefaults.standardUserDefaults().stringForKey("XCTestedBundlePath"),
+      bundle = NSBundle(path: bundlePath),
+      filePaths = bundle.pathsForResourcesOfType("json", inDirectory: nil) as? [String]
+    {
+      var error: NSError?
+      let strings = compressedMap(filePaths) {
+        JSONSerialization.stringByParsingDirectivesForFile($0, options: .InflateKeypaths, error: &error)
+      }
+      XCTAssertFalse(MSHandleError(error))
+      XCTAssertEqual(strings.count, filePaths.count)
+      measureBlock {
+        for string in strings {
+          XCTAssertNotNil(JSONParser(string: string, ignoreExcess: true).parse(error: &error))
+        }
+      }
+      XCTAssertFalse(MSHandleError(error))
+    } else { XCTFail("could not get file paths for json fixtures") }
   }
 
   func testMSDictionary() {
@@ -0,0 +1,361 @@
+//
+//  JSONDocument.swift
+//  MoonKit
+//
+//  Created by Jason Cardwell on 6/18/15.
+//  Copyright (c) 2015 Jason Cardwell. All rights reserved.
+//
+
+import Foundation
+
+/**
+An immutable JSON tree held in a single arena. Every value is a fixed size record in one array, laid out in document
+order so that the children of a container follow it and each record knows where its descendants end. Object keys are
+interned in a table shared by the whole document and the bytes of string values are kept in one buffer, nodes never
+own heap storage of their own.
+
+`Node` values are lightweight views into the arena. A node becomes a `JSONValue`, and from there an `ObjectJSONValue`
+or `ArrayJSONValue`, only when asked, which lets large documents be consumed one subtree at a time.
+*/
+public final class JSONDocument {
+
+  public enum Kind: UInt8 { case Null, Boolean, Number, String, Array, Object }
+
+  /** A value's entry in the arena */
+  struct Record {
+    let kind: Kind
+
+    /** Index into `keys` for members of an object, -1 otherwise */
+    let key: Int32
+
+    /** 0 or 1 for booleans, an index into `numbers` for numbers and an offset into `bytes` for strings */
+    let payload: Int32
+
+    /** Children of a container or bytes of a string */
+    var count: Int32
+
+    /** Index of the record following the last descendant */
+    var end: Int32
+  }
+
+  /** Storage for a document, filled by the events of a `JSONParser` or directly */
+  final class Arena: JSONParserDelegate {
+    private(set) var records: [Record] = []
+    private(set) var keys: [String] = []
+    private(set) var keyIndexes: [String:Int32] = [:]
+    private(set) var numbers: [NSNumber] = []
+    private(set) var bytes: [UInt8] = []
+
+    /** Containers that have been begun but not ended, innermost last */
+    private var open: [Int] = []
+
+    /** Key for the next record appended */
+    private var pendingKey: Int32 = -1
+
+    init() {}
+
+    /**
+    Initialize with a prebuilt key table, keys are then referenced with `addKeyIndex:`
+
+    :param: keys [String]
+    */
+    init(keys: [String]) {
+      self.keys = keys
+      for (index, key) in enumerate(keys) { keyIndexes[key] = Int32(index) }
+    }
+
+    /** Whether exactly one complete root value has been added */
+    var isComplete: Bool { return open.isEmpty && !records.isEmpty && Int(records[0].end) == records.count }
+
+    /**
+    beginContainer:
+
+    :param: kind Kind
+    */
+    func beginContainer(kind: Kind) {
+      appendRecord(kind, payload: 0, count: 0)
+      open.append(records.count - 1)
+    }
+
+    /** Ends the innermost container */
+    func endContainer() { records[open.removeLast()].end = Int32(records.count) }
+
+    /**
+    Interns `key` and makes it the key of the next value
+
+    :param: key String
+    */
+    func addKey(key: String) {
+      if let index = keyIndexes[key] { pendingKey = index }
+      else { pendingKey = Int32(keys.count); keyIndexes[key] = pendingKey; keys.append(key) }
+    }
+
+    /**
+    Makes the key at `index` the key of the next value
+
+    :param: index Int32
+    */
+    func addKeyIndex(index: Int32) { pendingKey = index }
+
+    func addNull() { appendRecord(.Null, payload: 0, count: 0) }
+
+    func addBoolean(boolean: Bool) { appendRecord(.Boolean, payload: boolean ? 1 : 0, count: 0) }
+
+    func addNumber(number: NSNumber) {
+      numbers.append(number)
+      appendRecord(.Number, payload: Int32(numbers.count - 1), count: 0)
+    }
+
+    func addString(string: String) {
+      let offset = bytes.count
+      bytes.extend(string.utf8)
+      appendRecord(.String, payload: Int32(offset), count: Int32(bytes.count - offset))
+    }
+
+    /**
+    Adds `value` and, for containers, all of its descendants
+
+    :param: value JSONValue
+    */
+    func addValue(value: JSONValue) {
+      switch value {
+        case .Null:           addNull()
+        case .Boolean(let b): addBoolean(b)
+        case .Number(let n):  addNumber(n)
+        case .String(let s):  addString(s)
+        case .Array(let a):
+          beginContainer(.Array)
+          for element in a { addValue(element) }
+          endContainer()
+        case .Object(let o):
+          beginContainer(.Object)
+          for i in 0 ..< o.count { addKey(o[i].1); addValue(o[i].2) }
+          endContainer()
+      }
+    }
+
+    /**
+    appendRecord:payload:count:
+
+    :param: kind Kind
+    :param: payload Int32
+    :param: count Int32
+    */
+    private func appendRecord(kind: Kind, payload: Int32, count: Int32) {
+      if let parent = open.last { records[parent].count++ }
+      records.append(Record(kind: kind, key: pendingKey, payload: payload, count: count, end: Int32(records.count + 1)))
+      pendingKey = -1
+    }
+
+    func parserDidBeginObject(parser: JSONParser) { beginContainer(.Object) }
+    func parserDidEndObject(parser: JSONParser) { endContainer() }
+    func parserDidBeginArray(parser: JSONParser) { beginContainer(.Array) }
+    func parserDidEndArray(parser: JSONParser) { endContainer() }
+    func parser(parser: JSONParser, didFindKey key: String) { addKey(key) }
+    func parser(parser: JSONParser, didFindValue value: JSONValue) { addValue(value) }
+  }
+
+  let arena: Arena
+
+  /** Whether objects have their key paths inflated as they are converted to `JSONValue` */
+  public let inflatesKeypaths: Bool
+
+  /** Number of values in the document */
+  public var count: Int { return arena.records.count }
+
+  /** The distinct object keys of the document */
+  public var keys: [String] { return arena.keys }
+
+  /** The root value */
+  public var root: Node { return Node(document: self, index: 0) }
+
+  /**
+  Initialize with a completed arena
+
+  :param: arena Arena
+  :param: inflateKeypaths Bool = false
+  */
+  init(arena: Arena, inflateKeypaths: Bool = false) {
+    assert(arena.isComplete, "documents are made from arenas holding a single complete value")
+    self.arena = arena
+    inflatesKeypaths = inflateKeypaths
+  }
+
+  /**
+  Parses JSON text straight into the arena, no `JSONValue` tree is built along the way. `InflateKeypaths` is applied
+  as nodes are converted to `JSONValue`.
+
+  :param: data NSData UTF-8 encoded JSON text
+  :param: options JSONSerialization.ReadOptions = .None
+  :param: error NSErrorPointer = nil
+  */
+  public init?(data: NSData, options: JSONSerialization.ReadOptions = .None, error: NSErrorPointer = nil) {
+    arena = Arena()
+    inflatesKeypaths = hasOption(JSONSerialization.ReadOptions.InflateKeypaths, options)
+    let parser = JSONParser(data: data, ignoreExcess: hasOption(JSONSerialization.ReadOptions.IgnoreExcess, options))
+    if !parser.parse(delegate: arena, error: error) || !arena.isComplete { return nil }
+  }
+
+  /**
+  Copies `value` into an arena
+
+  :param: value JSONValue
+  */
+  public convenience init(_ value: JSONValue) {
+    let arena = Arena()
+    arena.addValue(value)
+    self.init(arena: arena)
+  }
+
+  // MARK: - Nodes
+
+  /** A value in a document */
+  public struct Node: JSONValueConvertible {
+
+    public let document: JSONDocument
+    let index: Int
+
+    var record: Record { return document.arena.records[index] }
+
+    public var kind: Kind { return record.kind }
+
+    /** The key of the node when it is the member of an object */
+    public var key: String? { let key = record.key; return key < 0 ? nil : document.arena.keys[Int(key)] }
+
+    /** Number of elements or members, 0 for scalars */
+    public var count: Int {
+      switch record.kind { case .Array, .Object: return Int(record.count); default: return 0 }
+    }
+
+    /** The elements or members of the node */
+    public var children: [Node] {
+      var children: [Node] = []
+      children.reserveCapacity(count)
+      var child = index + 1
+      for _ in 0 ..< count { children.append(Node(document: document, index: child)); child = nextSibling(child) }
+      return children
+    }
+
+    /**
+    The element or member at `idx`
+
+    :param: idx Int
+
+    :returns: Node?
+    */
+    public subscript(idx: Int) -> Node? {
+      if idx < 0 || idx >= count { return nil }
+      var child = index + 1
+      for _ in 0 ..< idx { child = nextSibling(child) }
+      return Node(document: document, index: child)
+    }
+
+    /**
+    The member for `key` when the node is an object, keys are compared by their interned index
+
+    :param: key String
+
+    :returns: Node?
+    */
+    public subscript(key: String) -> Node? {
+      if record.kind != .Object { return nil }
+      if let keyIndex = document.arena.keyIndexes[key] {
+        var child = index + 1
+        for _ in 0 ..< count {
+          if document.arena.records[child].key == keyIndex { return Node(document: document, index: child) }
+          child = nextSibling(child)
+        }
+      }
+      return nil
+    }
+
+    public var boolValue: Bool? { return record.kind == .Boolean ? record.payload != 0 : nil }
+
+    public var numberValue: NSNumber? {
+      return record.kind == .Number ? document.arena.numbers[Int(record.payload)] : nil
+    }
+
+    public var stringValue: String? {
+      let record = self.record
+      if record.kind != .String { return nil }
+      return document.arena.bytes.withUnsafeBufferPointer {
+        (pointer: UnsafeBufferPointer<UInt8>) -> String? in
+        let bytes = pointer.baseAddress + Int(record.payload)
+        return NSString(bytes: bytes, length: Int(record.count), encoding: NSUTF8StringEncoding) as? String
+      }
+    }
+
+    /** The node and its descendants as a `JSONValue` */
+    public var jsonValue: JSONValue {
+      let value = document.valueAtIndex(index)
+      return document.inflatesKeypaths ? value.inflatedValue : value
+    }
+
+    /**
+    nextSibling:
+
+    :param: child Int
+
+    :returns: Int
+    */
+    private func nextSibling(child: Int) -> Int { return Int(document.arena.records[child].end) }
+  }
+
+  /**
+  Builds the `JSONValue` for the record at `index`
+
+  :param: index Int
+
+  :returns: JSONValue
+  */
+  private func valueAtIndex(index: Int) -> JSONValue {
+    let record = arena.records[index]
+    switch record.kind {
+      case .Null:    return .Null
+      case .Boolean: return .Boolean(record.payload != 0)
+      case .Number:  return .Number(arena.numbers[Int(record.payload)])
+      case .String:  return .String(Node(document: self, index: index).stringValue ?? "")
+
+      case .Array:
+        var array: JSONValue.ArrayValue = []
+        array.reserveCapacity(Int(record.count))
+        var child = index + 1
+        for _ in 0 ..< record.count { array.append(valueAtIndex(child)); child = Int(arena.records[child].end) }
+        return .Array(array)
+
+      case .Object:
+        var object = JSONValue.ObjectValue(minimumCapacity: Int(record.count))
+        var child = index + 1
+        for _ in 0 ..< record.count {
+          object[arena.keys[Int(arena.records[child].key)]] = valueAtIndex(child)
+          child = Int(arena.records[child].end)
+        }
+        return .Object(object)
+    }
+  }
+
+}
+
+extension ObjectJSONValue {
+  /**
+  Converts `node` when it is an object
+
+  :param: node JSONDocument.Node
+  */
+  public init?(_ node: JSONDocument.Node) {
+    if node.kind != .Object { return nil }
+    self.init(node.jsonValue)
+  }
+}
+
+extension ArrayJSONValue {
+  /**
+  Converts `node` when it is an array
+
+  :param: node JSONDocument.Node
+  */
+  public init?(_ node: JSONDocument.Node) {
+    if node.kind != .Array { return nil }
+    self.init(node.jsonValue)
+  }
+}
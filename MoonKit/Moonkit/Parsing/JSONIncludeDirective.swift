@@ -8,105 +8,353 @@
 
 import Foundation
 
-internal class JSONIncludeDirective {
-  let location: Range<Int>
-  let file: IncludeFile!
-
-  private let _parameters: String?
-  var parameters: [String:String]? {
-    if let p = _parameters {
-      return Dictionary(",".split(p).map({disperse2("=".split($0))}))
-    } else { return nil }
+/**
+Expands `<@include file.json,KEY=value,…>` directives. Each include file is compiled once into segments of text,
+`<#KEY#>` placeholders and directives, and is recompiled only when its modification date changes. The expansion of a
+file for a parameter list is memoized as a list of byte ranges along with the files it was built from, so nested
+includes are expanded once and a whole document is written into a single buffer in one pass.
+*/
+internal final class JSONIncludeDirective {
+
+  static func emptyCache() { dispatch_sync(queue) { JSONIncludeDirective.expansions = [:]; JSONIncludeDirective.files = [:] } }
+  static var cacheSize: Int { var size = 0; dispatch_sync(queue) { size = JSONIncludeDirective.expansions.count }; return size }
+
+  /** Serializes use of the caches, files may be parsed on several queues at once */
+  private static let queue = dispatch_queue_create("com.moondeerstudios.moonkit.json-include", DISPATCH_QUEUE_SERIAL)
+
+  /** Compiled include files keyed by path */
+  private static var files: [String:IncludeFile] = [:]
+
+  /** Expansions keyed by path and parameter list */
+  private static var expansions: [String:Expansion] = [:]
+
+  /** Paths whose modification dates have been checked during the current expansion */
+  private static var checkedPaths: Set<String> = []
+
+  /** A part of an expansion, either bytes or a placeholder left for the parameters of an enclosing directive */
+  private enum Piece {
+    case Bytes (NSData, NSRange)
+    case Placeholder (String)
   }
 
-  static func emptyCache() { cache = [:] }
-  static var cacheSize: Int { return cache.count }
-  private static var cache: [String:String] = [:]
-
-  let subdirectives: [JSONIncludeDirective]
-
-  init?(_ string: String, location loc: Range<Int>, directory: String) {
-    location = loc
-    let captures = string.matchFirst("<@include\\s+([^>]+\\.json)(?:,([^>]+))?>")
-    assert(captures.count == 2, "unexpected number of capture groups for regular expression")
-    _parameters = captures[1]
-    if let fileName = captures[0], includeFile = IncludeFile("\(directory)/\(fileName)") {
-      file = includeFile
-      subdirectives = JSONIncludeDirective.parseDirectives(file.content, directory: directory)
-    } else { file = nil; subdirectives = []; return nil }
+  /** A part of a compiled file */
+  private enum Segment {
+    case Text (NSRange)
+    case Placeholder (String)
+    case Include (String, String, NSRange)  // File name, parameter list, range of the directive
   }
 
-  static func stringByParsingDirectivesInString(string: String, directory: String) -> String {
-    var result = ""
-    var i = 0
-    for directive in parseDirectives(string, directory: directory) {
-      result += string[i..<directive.location.startIndex]
-      result += directive.content
-      i = directive.location.endIndex
+  /** The pieces of a file's expansion and the modification times of the files it was expanded from */
+  private struct Expansion {
+    let pieces: [Piece]
+    let dependencies: [String:NSTimeInterval]
+  }
+
+  /** An include file compiled into segments */
+  private final class IncludeFile {
+    let data: NSData
+    let modificationTime: NSTimeInterval
+    let segments: [Segment]
+
+    /**
+    initWithPath:modificationTime:
+
+    :param: path String
+    :param: modificationTime NSTimeInterval
+    */
+    init?(path: String, modificationTime: NSTimeInterval) {
+      self.modificationTime = modificationTime
+      if let data = NSData(contentsOfFile: path) {
+        self.data = data
+        segments = JSONIncludeDirective.segmentsOfData(data)
+      } else { data = NSData(); segments = []; return nil }
     }
-    if i < string.length { result += string[i..<string.length] }
-    return result
   }
 
-  private static func parseDirectives(string: String, directory: String) -> [JSONIncludeDirective] {
-    let ranges = compressed(string.rangesForCapture(1, byMatching: ~/"(<@include[^>]+>)"))
-    let directives = compressedMap(ranges, {JSONIncludeDirective(string[$0], location: $0, directory: directory)})
-    return directives
+  // MARK: - Expanding
+
+  /**
+  stringByParsingDirectivesInString:directory:
+
+  :param: string String
+  :param: directory String Directory against which included file names are resolved
+
+  :returns: String
+  */
+  static func stringByParsingDirectivesInString(string: String, directory: String) -> String {
+    if let data = string.dataUsingEncoding(NSUTF8StringEncoding),
+      result = NSString(data: dataByParsingDirectivesInData(data, directory: directory), encoding: NSUTF8StringEncoding)
+    {
+      return result as String
+    } else { return string }
   }
 
-  var description: String {
-    var result = "\n".join(
-      "location: \(location)",
-      "parameters: \(toString(parameters))",
-      "file: \(file.path.lastPathComponent)"
-    )
-    if subdirectives.count == 0 { result += "\nsubdirectives: []" }
-    else { result += "\nsubdirectives: {\n" + "\n\n".join(subdirectives.map({$0.description})).indentedBy(4) + "\n}" }
+  /**
+  dataByParsingDirectivesInData:directory:
+
+  :param: data NSData UTF-8 encoded text
+  :param: directory String Directory against which included file names are resolved
+
+  :returns: NSData
+  */
+  static func dataByParsingDirectivesInData(data: NSData, directory: String) -> NSData {
+    let result = NSMutableData(capacity: data.length)!
+    dispatch_sync(queue) {
+      JSONIncludeDirective.checkedPaths.removeAll(keepCapacity: true)
+      var dependencies: [String:NSTimeInterval] = [:]
+      let pieces = JSONIncludeDirective.piecesForSegments(JSONIncludeDirective.segmentsOfData(data),
+                                                     data: data,
+                                               parameters: [:],
+                                                directory: directory,
+                                             dependencies: &dependencies)
+      for piece in pieces {
+        switch piece {
+          case .Bytes(let bytes, let range):
+            result.appendBytes(UnsafePointer<UInt8>(bytes.bytes) + range.location, length: range.length)
+          case .Placeholder(let name):
+            result.appendData(JSONIncludeDirective.placeholderData(name))
+        }
+      }
+    }
     return result
   }
 
-  var content: String {
-    if let cachedContent = JSONIncludeDirective.cache["\(file.path),\(toString(_parameters))"] {
-      return cachedContent
+  /**
+  Substitutes `parameters` for the placeholders of `segments` and the expansions of their includes
+
+  :param: segments [Segment]
+  :param: data NSData The bytes `segments` refer to
+  :param: parameters [String:NSData]
+  :param: directory String
+  :param: dependencies [String:NSTimeInterval] Accumulates the files the pieces were expanded from
+
+  :returns: [Piece]
+  */
+  private static func piecesForSegments(segments: [Segment],
+                                   data: NSData,
+                             parameters: [String:NSData],
+                              directory: String,
+                        inout dependencies: [String:NSTimeInterval]) -> [Piece]
+  {
+    var pieces: [Piece] = []
+    pieces.reserveCapacity(segments.count)
+
+    let substitute = {(name: String) -> Piece in
+      if let value = parameters[name] { return .Bytes(value, NSRange(location: 0, length: value.length)) }
+      else { return .Placeholder(name) }
     }
-    var result: String = ""
-    let fileContent = file.content
-    if subdirectives.count == 0 { result = fileContent }
-    else {
-      var i = 0
-      for subdirective in subdirectives.sorted({$0.location.startIndex < $1.location.startIndex}) {
-        result += fileContent[i..<subdirective.location.startIndex]
-        result += subdirective.content
-        i = subdirective.location.endIndex
+
+    for segment in segments {
+      switch segment {
+        case .Text(let range):
+          pieces.append(.Bytes(data, range))
+        case .Placeholder(let name):
+          pieces.append(substitute(name))
+        case .Include(let fileName, let parameterList, let range):
+          if let expansion = expansionOfFile("\(directory)/\(fileName)", parameterList: parameterList, directory: directory) {
+            for (path, time) in expansion.dependencies { dependencies[path] = time }
+            for piece in expansion.pieces {
+              switch piece {
+                case .Placeholder(let name): pieces.append(substitute(name))
+                default: pieces.append(piece)
+              }
+            }
+          } else {
+            // Directives naming unreadable files are left in place
+            pieces.append(.Bytes(data, range))
+          }
       }
-      if i < fileContent.length { result += fileContent[i..<fileContent.length] }
     }
-    if let p = parameters {
-      result = reduce(p, result, {$0.stringByReplacingOccurrencesOfString("<#\($1.0)#>", withString: $1.1)})
-    }
-    JSONIncludeDirective.cache["\(file.path),\(toString(_parameters))"] = result
-    return result
+
+    return pieces
+  }
+
+  /**
+  The memoized expansion of the file at `path` with the parameters of `parameterList`
+
+  :param: path String
+  :param: parameterList String
+  :param: directory String
+
+  :returns: Expansion?
+  */
+  private static func expansionOfFile(path: String, parameterList: String, directory: String) -> Expansion? {
+    let key = "\(path),\(parameterList)"
+    if let expansion = expansions[key] where isCurrent(expansion) { return expansion }
+    if let file = currentFile(path) {
+      var dependencies = [path: file.modificationTime]
+      let pieces = piecesForSegments(file.segments,
+                                data: file.data,
+                          parameters: parametersFromList(parameterList),
+                           directory: directory,
+                        dependencies: &dependencies)
+      let expansion = Expansion(pieces: pieces, dependencies: dependencies)
+      expansions[key] = expansion
+      return expansion
+    } else { expansions[key] = nil; return nil }
+  }
+
+  /**
+  Whether none of the files an expansion was built from have changed since
+
+  :param: expansion Expansion
+
+  :returns: Bool
+  */
+  private static func isCurrent(expansion: Expansion) -> Bool {
+    for (path, time) in expansion.dependencies { if currentFile(path)?.modificationTime != time { return false } }
+    return true
   }
 
-  struct IncludeFile {
+  /**
+  The compiled file at `path`, recompiled if its modification date has changed. Dates are checked once per expansion.
 
-    let path: String
-    let content: String
-    private(set) lazy var parameters: Set<String> = {
-      return Set(flattened(self.content.matchAll(~/"<#([A-Z]+)#>").map({compressed($0)})))
-      }()
+  :param: path String
 
-    init?(_ p: String) {
-      if let cached = IncludeFile.cache[p] { self = cached }
-      else if NSFileManager.defaultManager().isReadableFileAtPath(p),
-        let c = String(contentsOfFile: p, encoding: NSUTF8StringEncoding, error: nil)
+  :returns: IncludeFile?
+  */
+  private static func currentFile(path: String) -> IncludeFile? {
+    if checkedPaths ∋ path { return files[path] }
+    checkedPaths.insert(path)
+    let attributes = NSFileManager.defaultManager().attributesOfItemAtPath(path, error: nil)
+    let time = (attributes?[NSFileModificationDate] as? NSDate)?.timeIntervalSinceReferenceDate ?? 0
+    if let file = files[path] where file.modificationTime == time { return file }
+    files[path] = IncludeFile(path: path, modificationTime: time)
+    return files[path]
+  }
+
+  /**
+  Parses a list of the form `KEY=value,KEY=value`
+
+  :param: list String
+
+  :returns: [String:NSData]
+  */
+  private static func parametersFromList(list: String) -> [String:NSData] {
+    var parameters: [String:NSData] = [:]
+    for entry in list.componentsSeparatedByString(",") {
+      if let separator = entry.rangeOfString("="),
+        value = entry.substringFromIndex(separator.endIndex).dataUsingEncoding(NSUTF8StringEncoding)
       {
-        path = p; content = c; IncludeFile.cache[p] = self
-      } else { path = ""; content = ""; return nil }
+        parameters[entry.substringToIndex(separator.startIndex)] = value
+      }
     }
+    return parameters
+  }
+
+  /**
+  placeholderData:
 
-    private static var cache: [String:IncludeFile] = [:]
+  :param: name String
+
+  :returns: NSData
+  */
+  private static func placeholderData(name: String) -> NSData {
+    return "<#\(name)#>".dataUsingEncoding(NSUTF8StringEncoding) ?? NSData()
   }
 
-}
+  // MARK: - Compiling
+
+  private static let DirectivePrefix = Array("<@include".utf8)
+  private static let JSONExtension = Array(".json".utf8)
+
+  /**
+  Splits `data` into text, placeholders and directives
+
+  :param: data NSData
+
+  :returns: [Segment]
+  */
+  private static func segmentsOfData(data: NSData) -> [Segment] {
+    let bytes = UnsafePointer<UInt8>(data.bytes)
+    let length = data.length
+    var segments: [Segment] = []
+    var textStart = 0
+    var i = 0
+
+    while i < length {
+      var scanned: (Segment, Int)?
+      if bytes[i] == UInt8(ascii: "<") && i + 1 < length {
+        if bytes[i + 1] == UInt8(ascii: "@") { scanned = scanDirective(bytes, length: length, start: i) }
+        else if bytes[i + 1] == UInt8(ascii: "#") { scanned = scanPlaceholder(bytes, length: length, start: i) }
+      }
+      if let scanned = scanned {
+        if textStart < i { segments.append(.Text(NSRange(location: textStart, length: i - textStart))) }
+        segments.append(scanned.0)
+        i = scanned.1
+        textStart = i
+      } else { i++ }
+    }
+    if textStart < length { segments.append(.Text(NSRange(location: textStart, length: length - textStart))) }
+
+    return segments
+  }
+
+  /**
+  Scans `<@include file.json>` or `<@include file.json,KEY=value,…>` beginning at `start`
+
+  :param: bytes UnsafePointer<UInt8>
+  :param: length Int
+  :param: start Int
+
+  :returns: (Segment, Int)? The directive and the index following it
+  */
+  private static func scanDirective(bytes: UnsafePointer<UInt8>, length: Int, start: Int) -> (Segment, Int)? {
+    let prefix = DirectivePrefix
+    if length - start < prefix.count { return nil }
+    for j in 0 ..< prefix.count { if bytes[start + j] != prefix[j] { return nil } }
+
+    var nameStart = start + prefix.count
+    let isSpace = {(byte: UInt8) -> Bool in byte == 0x20 || byte == 0x09 || byte == 0x0A || byte == 0x0D }
+    if nameStart >= length || !isSpace(bytes[nameStart]) { return nil }
+    while nameStart < length && isSpace(bytes[nameStart]) { nameStart++ }
+
+    var end = nameStart
+    while end < length && bytes[end] != UInt8(ascii: ">") { end++ }
+    if end >= length { return nil }
+
+    // The file name runs through the first `.json` followed by the parameter list or the closing bracket
+    var nameEnd: Int?
+    var candidate = nameStart + 1
+    while nameEnd == nil && candidate + JSONExtension.count <= end {
+      var matched = true
+      for j in 0 ..< JSONExtension.count { if bytes[candidate + j] != JSONExtension[j] { matched = false; break } }
+      let next = candidate + JSONExtension.count
+      if matched && (next == end || bytes[next] == UInt8(ascii: ",")) { nameEnd = next }
+      candidate++
+    }
+    if nameEnd == nil { return nil }
+
+    let string = {(from: Int, to: Int) -> String in
+      (NSString(bytes: bytes + from, length: to - from, encoding: NSUTF8StringEncoding) as? String) ?? ""
+    }
+    let parameterList = nameEnd! < end ? string(nameEnd! + 1, end) : ""
+    let segment = Segment.Include(string(nameStart, nameEnd!), parameterList, NSRange(location: start, length: end + 1 - start))
+    return (segment, end + 1)
+  }
+
+  /**
+  Scans a `<#KEY#>` placeholder beginning at `start`
 
+  :param: bytes UnsafePointer<UInt8>
+  :param: length Int
+  :param: start Int
+
+  :returns: (Segment, Int)? The placeholder and the index following it
+  */
+  private static func scanPlaceholder(bytes: UnsafePointer<UInt8>, length: Int, start: Int) -> (Segment, Int)? {
+    var end = start + 2
+    while end < length {
+      let byte = bytes[end]
+      if (byte >= UInt8(ascii: "A") && byte <= UInt8(ascii: "Z")) || (byte >= UInt8(ascii: "a") && byte <= UInt8(ascii: "z"))
+        || (byte >= UInt8(ascii: "0") && byte <= UInt8(ascii: "9")) || byte == UInt8(ascii: "_") { end++ }
+      else { break }
+    }
+    if end == start + 2 || end + 1 >= length || bytes[end] != UInt8(ascii: "#") || bytes[end + 1] != UInt8(ascii: ">") {
+      return nil
+    }
+    let name = (NSString(bytes: bytes + start + 2, length: end - start - 2, encoding: NSUTF8StringEncoding) as? String) ?? ""
+    return (Segment.Placeholder(name), end + 2)
+  }
+
+}
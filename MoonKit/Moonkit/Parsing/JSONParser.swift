@@ -10,7 +10,9 @@ import Foundation
 
 /**
 
-`JSONParser` is a simple class for parsing a JSON string into an object. The following grammar is used for parsing.
+`JSONParser` is a simple class for parsing a JSON string into an object. The text is parsed as UTF-8 bytes in a single
+pass, strings are created once their closing quotation mark is found. Values are reported to a `JSONParserDelegate` as
+they are scanned, `parse:` collects them into a tree with a `JSONValueBuilder`. The following grammar is used for parsing.
 *note: All whitespace excluding that which appears inside a quoted string is ignored.
 
 start → array | object
@@ -75,27 +77,46 @@ right-square-bracket → comment? ']' comment?
 */
 public class JSONParser {
 
-  public var string: String { return scanner.string }
+  public var string: String { return (NSString(data: data, encoding: NSUTF8StringEncoding) as? String) ?? "" }
   public let allowFragment: Bool
   public let ignoreExcess: Bool
-  public var idx:    Int    { get { return scanner.scanLocation } set { scanner.scanLocation = newValue } }
 
-  private var contextStack: Stack<Context>   = []
-  private var objectStack:  Stack<JSONValue> = []
-  private var keyStack:     Stack<String>    = []
-  private let scanner:      NSScanner
+  /** Offset in bytes of the next byte to parse */
+  public var idx = 0
+
+  private let data: NSData
+  private let bytes: UnsafePointer<UInt8>
+  private let length: Int
+
+  /** Whether each open container is an object, innermost last */
+  private var containers: [Bool] = []
 
   /**
-  initWithString:
+  initWithData:allowFragment:ignoreExcess:
 
-  :param: string String
+  :param: data NSData UTF-8 encoded text
+  :param: allowFragment Bool = false
+  :param: ignoreExcess Bool = false
   */
-  public init(string: String, allowFragment: Bool = false, ignoreExcess: Bool = false) {
-    scanner = NSScanner.localizedScannerWithString(string) as! NSScanner
+  public init(data: NSData, allowFragment: Bool = false, ignoreExcess: Bool = false) {
+    self.data = data
+    bytes = UnsafePointer<UInt8>(data.bytes)
+    length = data.length
     self.allowFragment = allowFragment
     self.ignoreExcess = ignoreExcess
   }
 
+  /**
+  initWithString:
+
+  :param: string String
+  */
+  public convenience init(string: String, allowFragment: Bool = false, ignoreExcess: Bool = false) {
+    self.init(data: string.dataUsingEncoding(NSUTF8StringEncoding) ?? NSData(),
+              allowFragment: allowFragment,
+              ignoreExcess: ignoreExcess)
+  }
+
 
   // MARK: - Error handling and debugging
 
@@ -191,606 +212,383 @@ public class JSONParser {
   dumpState
   */
   private func dumpState(error: NSError? = nil) {
-    println("scanner.atEnd? \(scanner.atEnd)\nidx: \(idx)")
-    println("keyStack[\(keyStack.count)]: " + ", ".join(keyStack.map{"'\($0)'"}))
-    println("contextStack[\(contextStack.count)]: " + ", ".join(contextStack.map{$0.rawValue}))
-    println("objectStack[\(objectStack.count)]:\n" + "\n".join(objectStack.map{toString($0)}))
+    println("atEnd? \(idx >= length)\nidx: \(idx)")
+    println("containers[\(containers.count)]: " + ", ".join(containers.map{$0 ? "object" : "array"}))
     if error != nil {
       println("error: \(detailedDescriptionForError(error!, depth: 0))")
     }
   }
 
 
-  // MARK: - Scanning the string
-
-  /** Enumeration to represent the current parser state */
-  private enum Context: String {
-    case Start  = "start"
-    case Object = "object"
-    case Value  = "value"
-    case Array  = "array"
-    case Key    = "key"
-    case End    = "end"
-  }
-
-  /** Enumeration for specifying a type of scan to perform */
-  private enum ScanType {
-    case CharactersFromSet     (NSCharacterSet)
-    case UpToCharactersFromSet (NSCharacterSet)
-    case Text                  (String)
-    case UpToText              (String)
-    case Number
+  // MARK: - Scanning the bytes
+
+  /** The bytes with meaning to the parser */
+  private struct ASCII {
+    static let Tab:          UInt8 = 0x09
+    static let LineFeed:     UInt8 = 0x0A
+    static let VerticalTab:  UInt8 = 0x0B
+    static let FormFeed:     UInt8 = 0x0C
+    static let Return:       UInt8 = 0x0D
+    static let Space:        UInt8 = 0x20
+    static let Quote:        UInt8 = 0x22
+    static let Asterisk:     UInt8 = 0x2A
+    static let Plus:         UInt8 = 0x2B
+    static let Comma:        UInt8 = 0x2C
+    static let Minus:        UInt8 = 0x2D
+    static let Period:       UInt8 = 0x2E
+    static let Solidus:      UInt8 = 0x2F
+    static let Zero:         UInt8 = 0x30
+    static let Nine:         UInt8 = 0x39
+    static let Colon:        UInt8 = 0x3A
+    static let LeftBracket:  UInt8 = 0x5B
+    static let Backslash:    UInt8 = 0x5C
+    static let RightBracket: UInt8 = 0x5D
+    static let LeftBrace:    UInt8 = 0x7B
+    static let RightBrace:   UInt8 = 0x7D
+    static let LowercaseE:   UInt8 = 0x65
+    static let UppercaseE:   UInt8 = 0x45
+
+    /** Literals in lowercase, they are matched ignoring case */
+    static let True  = Array("true".utf8)
+    static let False = Array("false".utf8)
+    static let Null  = Array("null".utf8)
   }
 
   /**
-  scanFor:into:discardingComments:skipping:error:
+  Advances `idx` past whitespace and comments
 
-  :param: type ScanType
-  :param: object AnyObject?
-  :param: discardingComments Bool = true
-  :param: skipCharacters NSCharacterSet = NSCharacterSet.whitespaceAndNewlineCharacterSet()
-  :param: error NSErrorPointer = nil
+  :param: error NSErrorPointer
 
-  :returns: Bool
+  :returns: Bool `false` if a comment is malformed
   */
-  private func scanFor(type: ScanType,
-            inout into object: AnyObject?,
-    discardingComments: Bool = true,
-              skipping skipCharacters: NSCharacterSet = NSCharacterSet.whitespaceAndNewlineCharacterSet(),
-                 error: NSErrorPointer = nil) -> Bool
-  {
-
-    var success = false
-
-    if discardingComments { scanComment(error) }
-
-    let currentSkipCharacters = scanner.charactersToBeSkipped
-    scanner.charactersToBeSkipped = skipCharacters
-
-    switch type {
-
-    case .CharactersFromSet(let set):
-      var scannedString: NSString?
-      success = scanner.scanCharactersFromSet(set, intoString: &scannedString)
-      if success { object = scannedString }
-
-    case .UpToCharactersFromSet(let set):
-      var scannedString: NSString?
-      success = scanner.scanUpToCharactersFromSet(set, intoString: &scannedString)
-      if success { object = scannedString }
-
-    case .Text (let text):
-      var scannedString: NSString?
-      success = scanner.scanString(text, intoString: &scannedString)
-      if success { object = scannedString }
-
-    case .UpToText(let text):
-      var scannedString: NSString?
-      success = scanner.scanUpToString(text, intoString: &scannedString)
-      if success { object = scannedString }
-
-    case .Number:
-      var scannedNumber: Double = 0
-      success = scanner.scanDouble(&scannedNumber)
-      if success { object = scannedNumber }
+  private func skipInsignificantBytes(error: NSErrorPointer) -> Bool {
+    while idx < length {
+      switch bytes[idx] {
+        case ASCII.Space, ASCII.Tab, ASCII.LineFeed, ASCII.Return, ASCII.VerticalTab, ASCII.FormFeed:
+          idx++
+
+        // U+00A0 is whitespace to `NSCharacterSet` as well
+        case 0xC2 where idx + 1 < length && bytes[idx + 1] == 0xA0:
+          idx += 2
+
+        case ASCII.Solidus:
+          let start = idx
+          idx++
+          if idx < length && bytes[idx] == ASCII.Solidus {
+            while idx < length && bytes[idx] != ASCII.LineFeed && bytes[idx] != ASCII.Return { idx++ }
+          } else if idx < length && bytes[idx] == ASCII.Asterisk {
+            idx++
+            while idx + 1 < length && !(bytes[idx] == ASCII.Asterisk && bytes[idx + 1] == ASCII.Solidus) { idx++ }
+            if idx + 1 >= length { idx = start; setSyntaxError(error, "open-ended multi-line comment"); return false }
+            idx += 2
+          } else { idx = start; setSyntaxError(error, "malformed comment detected"); return false }
 
+        default:
+          return true
+      }
     }
-
-    scanner.charactersToBeSkipped = currentSkipCharacters
-    if discardingComments { scanComment(error) }
-
-    return success
-
+    return true
   }
 
   /**
-  scanComment:
+  Scans the quoted string beginning at `idx`, the string's contents are kept as they appear including any escapes
 
   :param: error NSErrorPointer
-  */
-  private func scanComment(error: NSErrorPointer) {
-
-    var scannedObject: AnyObject?
-
-    // Try scanning the for solidus characters
-    if scanFor(.CharactersFromSet(NSCharacterSet(charactersInString: "/" )),
-      into: &scannedObject, discardingComments: false) {
-
-        if let scannedString = scannedObject as? String {
-
-          if scannedString.hasPrefix("//") {
-
-            scanFor(.UpToCharactersFromSet(NSCharacterSet.newlineCharacterSet()),
-              into: &scannedObject, discardingComments: false, skipping: NSCharacterSet(charactersInString: ""))
-
-          }
-
-          else if scanFor(.CharactersFromSet(NSCharacterSet(charactersInString: "*" )),
-            into: &scannedObject, discardingComments: false, skipping: NSCharacterSet(charactersInString: ""))
-          {
-            if !scanFor(.UpToText("*/"), into: &scannedObject, discardingComments: false) {
-              setSyntaxError(error, "open-ended multi-line comment")
-            }
-
-            else { scanFor(.Text("*/"), into: &scannedObject, discardingComments: false) }
 
-          }
-
-          else { setSyntaxError(error, "malformed comment detected") }
-
-        }
-
-        else { setInternalError(error, "scan succeeded but scanned object is empty") }
-
-    }
-
-  }
-
-  /**
-  scanNumber:
-
-  :param: number AnyObject?
-
-  :returns: Bool
+  :returns: String?
   */
-  private func scanNumber(inout number:AnyObject?) -> Bool { return scanFor(.Number, into: &number) }
-
-  /**
-  scanQuotedString:error:
-
-  :param: string AnyObject?
-  :param: error NSErrorPointer
-
-  :returns: Bool
-  */
-  private func scanQuotedString(inout string:AnyObject?, _ error: NSErrorPointer) -> Bool {
-
-    var scannedObject: AnyObject?
-    var success = false
-
-    if scanFor(.Text("\""), into: &scannedObject) {
-
-      var scannedString = ""
-
-      // Check if we have an empty string
-      if scanFor(.Text("\""), into: &scannedObject) { success = true }
-
-      else {
-
-        while !success && scanFor(.UpToCharactersFromSet(NSCharacterSet(charactersInString: "\"")),
-          into: &scannedObject, skipping: NSCharacterSet(charactersInString: ""))
-        {
-          // Make sure we scanned something and that we didn't scan up to an escaped quotation mark
-          if let s = scannedObject as? String {
-
-            scannedString += s // Append what we just scanned to accumulating string
-
-            // Set success if our quotation mark was not escaped
-            if !s.hasSuffix("\\") { success = true }
-
-          }
-
-        }
-
-        // At this point, to be valid syntax we must have scanned an opening quotation mark,
-        // some text, and be sitting on an unescaped quotation mark
-        if !(success && scanFor(.Text("\""), into: &scannedObject, skipping: NSCharacterSet(charactersInString: ""))) {
-
-          success = false
-          setSyntaxError(error, "unmatched double quote")
-
-        }
-
+  private func scanQuotedString(error: NSErrorPointer) -> String? {
+    let start = idx + 1
+    idx = start
+    while idx < length {
+      switch bytes[idx] {
+        case ASCII.Quote:
+          let string = NSString(bytes: bytes + start, length: idx - start, encoding: NSUTF8StringEncoding) as? String
+          if string == nil { setSyntaxError(error, "string is not valid UTF-8") } else { idx++ }
+          return string
+        case ASCII.Backslash:
+          idx += 2
+        default:
+          idx++
       }
-
-      // If we have succeeded, be sure to set the inout parameter to our accumulated string
-      if success { string = scannedString }
-
     }
-
-    return success
-
+    idx = start - 1
+    setSyntaxError(error, "unmatched double quote")
+    return nil
   }
 
-
-  // MARK: - Parsing the string
-
-
-
   /**
-  parseObject:
-
-  :param: error NSErrorPointer = nil
+  Scans the number beginning at `idx`
 
-  :returns: Bool
+  :returns: NSNumber?
   */
-  private func parseObject(error: NSErrorPointer = nil) -> Bool {
-
-    var success = false
-    var localError: NSError?
-    var scannedObject: AnyObject?
-
-    // Try to scan the opening punctuation for an object
-    if scanFor(.Text("{"), into: &scannedObject, error: &localError) {
-
-      success = true
-      objectStack.push(.Object([:])) // Push a new dictionary onto the object stack
-      contextStack.push(.Object)     // Push object context
-      contextStack.push(.Key)        // Push key context
-
-
+  private func scanNumber() -> NSNumber? {
+    let start = idx
+    var integer = 0
+    var digits = 0
+    var isInteger = true
+
+    if bytes[idx] == ASCII.Minus || bytes[idx] == ASCII.Plus { idx++ }
+    while idx < length {
+      let byte = bytes[idx]
+      if byte >= ASCII.Zero && byte <= ASCII.Nine {
+        integer = integer &* 10 &+ Int(byte - ASCII.Zero)
+        digits++
+      } else if byte == ASCII.Period || byte == ASCII.LowercaseE || byte == ASCII.UppercaseE {
+        isInteger = false
+      } else if (byte == ASCII.Minus || byte == ASCII.Plus)
+        && (bytes[idx - 1] == ASCII.LowercaseE || bytes[idx - 1] == ASCII.UppercaseE)
+      {
+        isInteger = false
+      } else { break }
+      idx++
     }
 
-    // Then try to scan a comma separating another object key value pair
-    else if scanFor(.Text(","), into: &scannedObject, error: &localError) {
-      success = true
-      contextStack.push(.Key)
+    // Integers that fit in a double's mantissa skip `strtod`
+    if isInteger && digits > 0 && digits < 16 {
+      return NSNumber(double: Double(bytes[start] == ASCII.Minus ? -integer : integer))
     }
 
-      // Lastly, try to scan the closing punctuation for an object
-    else if scanFor(.Text("}"), into: &scannedObject, error: &localError) {
-
-      // Pop context and object stacks
-      if let context = contextStack.pop(), object = objectStack.pop() {
-
-        switch (context, object) {
-
-          case (_, _) where contextStack.peek == .Start:
-            // Replace start context with end context if we have completed the root object
-            contextStack.pop()
-            contextStack.push(.End)
-            objectStack.push(object)
-            success = true
-
-          case (.Object, .Object(_)):
-            success = addValueToTopObject(object, error)
-
-          case (_, .Object(_)):
-            setInternalError(error, "incorrect context popped off of stack", underlyingError: localError)
-
-          case (.Object, _):
-            setInternalError(error, "dictionary absent from object stack", underlyingError: localError)
-
-          default:
-            assert(false, "shouldn't this be unreachable?")
-        }
-
-      }
-
-      else { setInternalError(error, "one or both of context and object stacks is empty", underlyingError: localError) }
-
+    var characters = [CChar](count: idx - start + 1, repeatedValue: 0)
+    for i in 0 ..< idx - start { characters[i] = CChar(bitPattern: bytes[start + i]) }
+    var consumed = 0
+    let number = characters.withUnsafeBufferPointer {
+      (buffer: UnsafeBufferPointer<CChar>) -> Double in
+        var end: UnsafeMutablePointer<CChar> = nil
+        let number = strtod(buffer.baseAddress, &end)
+        consumed = UnsafePointer<CChar>(end) - buffer.baseAddress
+        return number
     }
-
-    return success
-
+    if consumed == 0 { idx = start; return nil }
+    idx = start + consumed
+    return NSNumber(double: number)
   }
 
   /**
-  parseArray:
+  Scans `literal` at `idx` ignoring case
 
-  :param: error NSErrorPointer = nil
+  :param: literal [UInt8]
 
   :returns: Bool
   */
-  private func parseArray(error: NSErrorPointer = nil) -> Bool {
-
-    var success = false
-    var localError: NSError?
-    var scannedObject: AnyObject?
-
-    // Try to scan the opening punctuation for an object
-    if scanFor(.Text("["), into: &scannedObject, error: &localError) {
-
-      success = true
-      objectStack.push(.Array([])) // Push a new array onto the object stack
-      contextStack.push(.Array)    // Push the array context
-      contextStack.push(.Value)    // Push the value context
-
-    }
-
-      // Then try to scan a comma separating another object key value pair
-    else if scanFor(.Text(","), into: &scannedObject, error: &localError) {
-      success = true
-      contextStack.push(.Value)
-    }
-
-      // Lastly, try to scan the closing punctuation for an object
-    else if scanFor(.Text("]"), into: &scannedObject, error: &localError) {
-
-      // Pop context and object stacks
-      if let context = contextStack.pop(), object = objectStack.pop() {
-
-        switch (context, object) {
-        case (_, _) where contextStack.peek == .Start:
-          // Replace start context with end context if we have completed the root object
-          contextStack.pop()
-          contextStack.push(.End)
-          objectStack.push(object)
-          success = true
-
-        case (.Array, .Array(_)):
-          success = addValueToTopObject(object, error)
-
-        case (_, .Array(_)):
-          setInternalError(error, "incorrect context popped off of stack", underlyingError: localError)
+  private func scanLiteral(literal: [UInt8]) -> Bool {
+    if length - idx < literal.count { return false }
+    for i in 0 ..< literal.count { if bytes[idx + i] | 0x20 != literal[i] { return false } }
+    idx += literal.count
+    return true
+  }
 
-        case (.Array, _):
-          setInternalError(error, "array absent from object stack", underlyingError: localError)
 
-        default:
-          assert(false, "shouldn't this be unreachable?")
-        }
-      }
+  // MARK: - Parsing the bytes
 
-      else { setInternalError(error, "one or both of context and object stacks is empty", underlyingError: localError) }
+  /** What the parser expects to find at `idx` */
+  private enum Expectation { case Value, ValueOrEnd, Key, KeyOrEnd, SeparatorOrEnd }
 
-    }
+  /**
+  parse:
 
-    return success
+  :param: error NSErrorPointer = nil
 
+  :returns: JSONValue?
+  */
+  public func parse(error: NSErrorPointer = nil) -> JSONValue? {
+    let builder = JSONValueBuilder()
+    return parse(delegate: builder, error: error) ? builder.value : nil
   }
 
   /**
-  parseValue:
+  Parses the text reporting each value to `delegate` as it is scanned, nothing is retained by the parser beyond the kind
+  of each open container
 
+  :param: delegate JSONParserDelegate
   :param: error NSErrorPointer = nil
 
-  :returns: Bool
+  :returns: Bool Whether the text parsed without error, `delegate` may have received events either way
   */
-  private func parseValue(error: NSErrorPointer = nil) -> Bool {
+  public func parse(#delegate: JSONParserDelegate, error: NSErrorPointer = nil) -> Bool {
 
-    var success = false
-    var value: JSONValue?
-    var scanError: NSError?
-    var scannedObject: AnyObject?
+    idx = 0
+    containers.removeAll(keepCapacity: true)
 
-    if !(contextStack.pop() == Context.Value) {
-      setInternalError(error, "incorrect context popped off of stack")
-      return false
-    }
+    var expectation = Expectation.Value
+    var complete = false  // Set once the root value closes
 
-    // Try scanning a true literal
-    if scanFor(.Text("true"), into: &scannedObject, error: &scanError) {
-      value = true
-      success = true
-    }
+    // Scan until the root value completes, text may remain
+    while !complete {
 
-      // Try scanning a false literal
-    else if scanFor(.Text("false"), into: &scannedObject, error: &scanError) {
-      value = false
-      success = true
-    }
+      if !skipInsignificantBytes(error) { return false }
+      if idx >= length { setSyntaxError(error, "unexpected end of text"); return false }
 
-      // Try scanning a null literal
-    else if scanFor(.Text("null"), into: &scannedObject, error: &scanError) {
-      value = .Null
-      success = true
-    }
-
-      // Try scanning a number
-    else if scanFor(.Number, into: &scannedObject, error: &scanError) {
-      value = .Number(scannedObject as! NSNumber)
-      success = true
-    }
+      let byte = bytes[idx]
+      var valueEnded = false  // Set when a value, including a container, completes
 
-      // Try scanning a string
-    else if scanQuotedString(&scannedObject, &scanError) {
-      value = .String(scannedObject as! Swift.String)
-      success = true
-    }
+      switch expectation {
 
-      // Try scanning an object
-    else if parseObject(error: &scanError) { success = true }
-
-      // Try scanning an array
-    else if parseArray(error: &scanError) { success = true }
-
-      // Set error if we failed to scan anything
-    else { setSyntaxError(error, "failed to parse value", underlyingError: scanError) }
+        // Try to scan a number, a boolean, null, a string, the start of an object, or the start of an array
+        case .Value, .ValueOrEnd:
+          if containers.isEmpty && !allowFragment && byte != ASCII.LeftBrace && byte != ASCII.LeftBracket {
+            setSyntaxError(error, "root must be an object/array")
+            return false
+          }
+          switch byte {
+            case ASCII.RightBracket where expectation == .ValueOrEnd:
+              idx++
+              containers.removeLast()
+              delegate.parserDidEndArray(self)
+              valueEnded = true
+            case ASCII.LeftBrace:
+              idx++
+              containers.append(true)
+              delegate.parserDidBeginObject(self)
+              expectation = .KeyOrEnd
+            case ASCII.LeftBracket:
+              idx++
+              containers.append(false)
+              delegate.parserDidBeginArray(self)
+              expectation = .ValueOrEnd
+            case ASCII.Quote:
+              if let string = scanQuotedString(error) { delegate.parser(self, didFindValue: .String(string)) }
+              else { return false }
+              valueEnded = true
+            case ASCII.Minus, ASCII.Plus, ASCII.Period, ASCII.Zero ... ASCII.Nine:
+              if let number = scanNumber() { delegate.parser(self, didFindValue: .Number(number)) }
+              else { setSyntaxError(error, "failed to parse value"); return false }
+              valueEnded = true
+            default:
+              if scanLiteral(ASCII.True) { delegate.parser(self, didFindValue: .Boolean(true)) }
+              else if scanLiteral(ASCII.False) { delegate.parser(self, didFindValue: .Boolean(false)) }
+              else if scanLiteral(ASCII.Null) { delegate.parser(self, didFindValue: .Null) }
+              else { setSyntaxError(error, "failed to parse value"); return false }
+              valueEnded = true
+          }
 
-    // If we have a value, add it to the top object in our stack
-    if let v = value where success {
+        // Try to scan a quoted string and colon for use as a dictionary key
+        case .Key, .KeyOrEnd:
+          if byte == ASCII.RightBrace && expectation == .KeyOrEnd {
+            idx++
+            containers.removeLast()
+            delegate.parserDidEndObject(self)
+            valueEnded = true
+          } else if byte != ASCII.Quote {
+            setSyntaxError(error, "missing key for object element")
+            return false
+          } else if let key = scanQuotedString(error) {
+            if !skipInsignificantBytes(error) { return false }
+            if idx >= length || bytes[idx] != ASCII.Colon { setSyntaxError(error, "missing colon after key"); return false }
+            idx++
+            delegate.parser(self, didFindKey: key)
+            expectation = .Value
+          } else { return false }
+
+        // Try to scan a comma or the bracket closing the innermost container
+        case .SeparatorOrEnd:
+          let isObject = containers[containers.count - 1]
+          if byte == ASCII.Comma {
+            idx++
+            expectation = isObject ? .Key : .ValueOrEnd
+          } else if byte == (isObject ? ASCII.RightBrace : ASCII.RightBracket) {
+            idx++
+            containers.removeLast()
+            if isObject { delegate.parserDidEndObject(self) } else { delegate.parserDidEndArray(self) }
+            valueEnded = true
+          } else {
+            setSyntaxError(error, isObject ? "expected ',' or '}' in object" : "expected ',' or ']' in array")
+            return false
+          }
 
-      var addValueError: NSError?
-      success = addValueToTopObject(v, &addValueError)
+      }
 
-      // Handle error adding value if not successful
-      if addValueError != nil {
-        setInternalError(error, "error encountered while adding parsed value", underlyingError: addValueError)
+      if valueEnded {
+        if containers.isEmpty { complete = true } else { expectation = .SeparatorOrEnd }
       }
 
     }
 
-    return success
-
-  }
-
-  /**
-  parseKey:
-
-  :param: error NSErrorPointer = nil
-
-  :returns: Bool
-  */
-  private func parseKey(error: NSErrorPointer = nil) -> Bool {
+    if !ignoreExcess {
+      if !skipInsignificantBytes(error) { return false }
+      if idx < length { setSyntaxError(error, "parse completed but scanner is not at end"); return false }
+    }
 
-    var success = false
-    var localError: NSError?
-    var scannedObject: AnyObject?
+    return true
 
-    // Set error if we can't scan a string
-    if !scanQuotedString(&scannedObject, &localError) {
-      setSyntaxError(error, "missing key for object element", underlyingError: localError)
-    }
+  }
 
-    // Otherwise process what we have scanned
-    else {
+}
 
-      // Pop off context, making sure it is of the correct value
-      if contextStack.pop() != .Key {
-        setInternalError(error, "incorrect context popped off of stack", underlyingError: localError)
-      }
+// MARK: - Delegate
 
-        // Otherwise push the key we scanned into the key stack and look for a colon
-      else if let key = scannedObject as? String {
+/**
+Receives the values scanned by `JSONParser` in the order they appear. Scalars arrive through `parser:didFindValue:`, the
+members of an object alternate between a key and a value.
+*/
+public protocol JSONParserDelegate: class {
+  func parserDidBeginObject(parser: JSONParser)
+  func parserDidEndObject(parser: JSONParser)
+  func parserDidBeginArray(parser: JSONParser)
+  func parserDidEndArray(parser: JSONParser)
+  func parser(parser: JSONParser, didFindKey key: String)
+  func parser(parser: JSONParser, didFindValue value: JSONValue)
+}
 
-        keyStack.push(key)
+/**
+Builds a `JSONValue` from the events of a `JSONParser`. When `elementHandler` is set each element of a root array is
+handed to it once complete instead of being added to the array, so that no more than one element is held at a time.
+*/
+public final class JSONValueBuilder: JSONParserDelegate {
 
-        // Parse the delimiting colon
-        if !scanFor(.Text(":"), into: &scannedObject, error: &localError) {
-          setSyntaxError(error, "missing colon after key", underlyingError: localError)
-        }
+  /** The root value once parsing completes, an empty array when the root array's elements went to `elementHandler` */
+  public private(set) var value: JSONValue?
 
-        // Push value context and set success if we found the colon
-        else { contextStack.push(.Value); success = true }
+  /** Invoked with each element of a root array */
+  public var elementHandler: ((JSONValue) -> Void)?
 
-      }
+  /** An object or array whose members are being parsed */
+  private struct Container {
+    let isObject: Bool
+    var object: JSONValue.ObjectValue = [:]
+    var array: JSONValue.ArrayValue = []
 
-    }
+    /** Key of the object member whose value is being parsed */
+    var key: String?
 
-    return success
+    init(isObject: Bool) { self.isObject = isObject }
 
+    var value: JSONValue { return isObject ? .Object(object) : .Array(array) }
   }
 
+  private var containers: [Container] = []
 
   /**
-  addValueToTopObject:error:
-
-  :param: value AnyObject
-  :param: error NSErrorPointer = nil
+  initWithElementHandler:
 
-  :returns: Bool
+  :param: elementHandler ((JSONValue) -> Void)? = nil
   */
-  private func addValueToTopObject(value: JSONValue, _ error: NSErrorPointer = nil) -> Bool {
-
-    var success = false
-
-    if let context = contextStack.peek, object = objectStack.pop() {
-
-      switch (context, object) {
-        case (.Object, .Object(var d)):
-          if let k = keyStack.pop() {
-            d[k] = value
-            objectStack.push(.Object(d))
-            success = true
-          } else { setInternalError(error, "empty key stack") }
-
-        case (.Array, .Array(var a)):
-          a.append(value)
-          objectStack.push(.Array(a))
-          success = true
-
-        case (_, .Object(_)),
-             (_, .Array(_)):
-          setInternalError(error, "invalid context-object pairing: \(context)-\(object)")
-
-        case (.Object, _),
-             (.Array, _):
-          setInternalError(error, "missing object in stack to receive new value")
-
-        default:
-          assert(false, "should be unreachable?")
-      }
-
-    } else if allowFragment && objectStack.isEmpty {
-      objectStack.push(value)
-      success = true
-      if contextStack.peek == .Start { contextStack.pop(); contextStack.push(.End) }
-    } else if contextStack.isEmpty && objectStack.isEmpty {
-      setInternalError(error, "empty stacks")
-    } else if contextStack.isEmpty {
-      setInternalError(error, "empty context stack")
-    } else if objectStack.isEmpty {
-      setInternalError(error, "empty object stack")
-    } else {
-      setInternalError(error, "an unknown internal error has occurred")
-    }
-
-    return success
-
-  }
+  public init(elementHandler: ((JSONValue) -> Void)? = nil) { self.elementHandler = elementHandler }
 
   /**
-  parse:
+  Adds `value` to the innermost container, or makes it the root value
 
-  :param: error NSErrorPointer = nil
-
-  :returns: JSONValue?
+  :param: value JSONValue
   */
-  public func parse(error: NSErrorPointer = nil) -> JSONValue? {
-
-    // Start in a known context
-    contextStack.push(.Start)
-
-    // Scan while we have input, completing the root object will exit the loop even if text remains
-    scanLoop: while !scanner.atEnd {
-
-      // We must have a context on top of the context stack
-      if let context = contextStack.peek {
-
-        // Perform a context-appropriate action
-        switch context {
-
-          // To be valid, we must be able to scan an opening bracked of some kind
-          case .Start:
-
-            // Check if we are allowing the string to be a json fragment
-            if allowFragment {
-              contextStack.push(.Value)
-              if !parseValue(error: error) {
-                setSyntaxError(error, "root is not a valid json fragment")
-                return nil
-              }
-            }
-
-            // Set error if we fail to match the start of an array or an object and exit loop
-            else if !(parseObject(error: error) || parseArray(error: error)) {
-              setSyntaxError(error, "root must be an object/array")
-              return nil
-            }
-
-          // Try to scan a number, a boolean, null, the start of an object, or the start of an array
-          case .Value: if !parseValue(error: error) { break scanLoop }
-
-          // Try to scan a comma or curly bracket
-          case .Object: if !parseObject(error: error) { break scanLoop }
-
-          // Try to scan a comma or square bracket
-          case .Array: if !parseArray(error: error) { break scanLoop }
-
-          // Try to scan a quoted string for use as a dictionary key
-          case .Key: if !parseKey(error: error) { break scanLoop }
-
-          // Just break out of scan loop
-          case .End:
-            if !(scanner.atEnd || ignoreExcess) {
-              setSyntaxError(error, "parse completed but scanner is not at end")
-              return nil
-            }
-            break scanLoop
-
-        }
-
-      } // else { contextStack.push(.End) }
-
-
-    }
-
-    var object: JSONValue?  // Variable to hold result to be returned
-
-    // If the root object ends the text we won't hit the `.End` case in our switch statement
-    if !objectStack.isEmpty {
-
-      // Make sure we don't have more than one object left in the stack
-      if objectStack.count > 1 { setInternalError(error, "objects left in stack") }
-
-      // Otherwise pop the root object from the stack
-      else { object = objectStack.pop() }
-
+  private func addValue(value: JSONValue) {
+    let top = containers.count - 1
+    if top < 0 {
+      self.value = value
+    } else if containers[top].isObject {
+      containers[top].object[containers[top].key!] = value
+      containers[top].key = nil
+    } else if top == 0 && elementHandler != nil {
+      elementHandler!(value)
+    } else {
+      containers[top].array.append(value)
     }
-
-    return object
-
   }
 
+  public func parserDidBeginObject(parser: JSONParser) { containers.append(Container(isObject: true)) }
+  public func parserDidEndObject(parser: JSONParser) { addValue(containers.removeLast().value) }
+  public func parserDidBeginArray(parser: JSONParser) { containers.append(Container(isObject: false)) }
+  public func parserDidEndArray(parser: JSONParser) { addValue(containers.removeLast().value) }
+  public func parser(parser: JSONParser, didFindKey key: String) { containers[containers.count - 1].key = key }
+  public func parser(parser: JSONParser, didFindValue value: JSONValue) { addValue(value) }
+
 }
@@ -22,16 +22,35 @@ public class JSONSerialization {
   public class func stringByParsingDirectivesForFile(filePath: String,
                                              options: ReadOptions = .None,
                                                error: NSErrorPointer = nil) -> String?
+  {
+    if let data = dataByParsingDirectivesForFile(filePath, options: options, error: error) {
+      return NSString(data: data, encoding: NSUTF8StringEncoding) as? String
+    } else { return nil }
+  }
+
+  /**
+  The UTF-8 encoded content of the file with any '<@include file/to/include.json>' directives replaced by the content
+  of the files they name
+
+  :param: filePath String
+  :param: options ReadOptions = .None
+  :param: error NSErrorPointer = nil
+
+  :returns: NSData?
+  */
+  public class func dataByParsingDirectivesForFile(filePath: String,
+                                           options: ReadOptions = .None,
+                                             error: NSErrorPointer = nil) -> NSData?
   {
     var localError: NSError?      // So we can intercept errors before passing them along to caller
 
     // Get the contents of the file to parse
-    if var string = String(contentsOfFile: filePath, encoding: NSUTF8StringEncoding, error: &localError)
+    if let data = NSData(contentsOfFile: filePath, options: .DataReadingMappedIfSafe, error: &localError)
       where !handledError(localError, errorCode: NSFileReadUnknownError, error: error)
     {
-      // Look for include entries in the file-loaded string
+      // Look for include entries in the file-loaded data
       let directory = filePath.stringByDeletingLastPathComponent
-      let result = JSONIncludeDirective.stringByParsingDirectivesInString(string, directory: directory)
+      let result = JSONIncludeDirective.dataByParsingDirectivesInData(data, directory: directory)
       if JSONIncludeDirective.cacheSize > 100 { JSONIncludeDirective.emptyCache() }
       return result
     }
@@ -87,8 +106,8 @@ public class JSONSerialization {
   }
 
   /**
-  This method calls `objectByParsingString:options:error` with the content of the specified file after attempting to replace
-  any '<@include file/to/include.json>' directives with their respective file content.
+  This method parses the content of the specified file as `objectByParsingString:options:error` does after attempting to
+  replace any '<@include file/to/include.json>' directives with their respective file content.
 
   :param: filePath String
   :param: options JSONSerializationReadOptions = .None
@@ -99,13 +118,109 @@ public class JSONSerialization {
   public class func objectByParsingFile(filePath: String, options: ReadOptions = .None, error: NSErrorPointer = nil) -> JSONValue? {
     var localError: NSError?      // So we can intercept errors before passing them along to caller
 
-    if let string = stringByParsingDirectivesForFile(filePath, options: options, error: error)
+    if let data = dataByParsingDirectivesForFile(filePath, options: options, error: error)
       where !handledError(localError, errorCode: NSFileReadUnknownError, error: error)
     {
-      return objectByParsingString(string, options: options, error: error)
+      var object = JSONParser(data: data, ignoreExcess: hasOption(ReadOptions.IgnoreExcess, options)).parse(error: error)
+      if hasOption(ReadOptions.InflateKeypaths, options) { object = object?.inflatedValue }
+      return object
+    } else { return nil }
+  }
+
+  /**
+  Parses the file as `objectByParsingFile:options:error:` does except that each element of a root array is handed to
+  `elementHandler` as soon as it has been parsed, only one element is held at a time
+
+  :param: filePath String
+  :param: options ReadOptions = .None
+  :param: error NSErrorPointer = nil
+  :param: elementHandler (JSONValue) -> Void
+
+  :returns: JSONValue? The root object, or an empty array when the root is an array
+  */
+  public class func objectByParsingFile(filePath: String,
+                                options: ReadOptions = .None,
+                                  error: NSErrorPointer = nil,
+                         elementHandler: (JSONValue) -> Void) -> JSONValue?
+  {
+    if let data = dataByParsingDirectivesForFile(filePath, options: options, error: error) {
+      let inflate = hasOption(ReadOptions.InflateKeypaths, options)
+      let builder = JSONValueBuilder(elementHandler: { elementHandler(inflate ? $0.inflatedValue : $0) })
+      let parser = JSONParser(data: data, ignoreExcess: hasOption(ReadOptions.IgnoreExcess, options))
+      if parser.parse(delegate: builder, error: error) { return inflate ? builder.value?.inflatedValue : builder.value }
+    }
+    return nil
+  }
+
+  /**
+  Produces the same value as `objectByParsingFile:options:error:` but reads it from the `JSONSnapshot` at
+  `snapshotPath` when the snapshot was made from the file's current content. Otherwise the file is parsed and the
+  snapshot is replaced, a snapshot that cannot be written is simply skipped.
+
+  :param: filePath String
+  :param: options ReadOptions = .None
+  :param: snapshotPath String
+  :param: error NSErrorPointer = nil
+
+  :returns: JSONValue?
+  */
+  public class func objectByParsingFile(filePath: String,
+                                options: ReadOptions = .None,
+                           snapshotPath: String,
+                                  error: NSErrorPointer = nil) -> JSONValue?
+  {
+    return documentByParsingFile(filePath, options: options, snapshotPath: snapshotPath, error: error)?.root.jsonValue
+  }
+
+  /**
+  Parses the file as `objectByParsingFile:options:error:` does but into a `JSONDocument`, no `JSONValue` tree is built
+
+  :param: filePath String
+  :param: options ReadOptions = .None
+  :param: error NSErrorPointer = nil
+
+  :returns: JSONDocument?
+  */
+  public class func documentByParsingFile(filePath: String,
+                                  options: ReadOptions = .None,
+                                    error: NSErrorPointer = nil) -> JSONDocument?
+  {
+    if let data = dataByParsingDirectivesForFile(filePath, options: options, error: error) {
+      return JSONDocument(data: data, options: options, error: error)
     } else { return nil }
   }
 
+  /**
+  Parses the file into a `JSONDocument`, reading it from the `JSONSnapshot` at `snapshotPath` when the snapshot was made
+  from the file's current content. Otherwise the file is parsed and the snapshot is replaced, a snapshot that cannot be
+  written is simply skipped.
+
+  :param: filePath String
+  :param: options ReadOptions = .None
+  :param: snapshotPath String
+  :param: error NSErrorPointer = nil
+
+  :returns: JSONDocument?
+  */
+  public class func documentByParsingFile(filePath: String,
+                                  options: ReadOptions = .None,
+                             snapshotPath: String,
+                                    error: NSErrorPointer = nil) -> JSONDocument?
+  {
+    if let data = dataByParsingDirectivesForFile(filePath, options: options, error: error) {
+      let sourceHash = JSONSnapshot.hashData(data, seed: UInt64(options.rawValue))
+      if let snapshot = JSONSnapshot(contentsOfFile: snapshotPath) where snapshot.sourceHash == sourceHash,
+        let document = snapshot.document(options: options)
+      {
+        return document
+      }
+      let document = JSONDocument(data: data, options: options, error: error)
+      if document != nil { JSONSnapshot.writeDocument(document!, toFile: snapshotPath, sourceHash: sourceHash) }
+      return document
+    }
+    return nil
+  }
+
 }
 
 // Mark - Read/Write options type definitions
@@ -135,23 +250,29 @@ extension JSONSerialization {
     public init(rawValue: UInt) { self.rawValue = rawValue }
     public init(nilLiteral: Void) { self.rawValue = 0 }
 
-    static var None                          : WriteOptions = WriteOptions(rawValue: 0b0000_0000_0000_0000)
-    static var PreserveWhitespace            : WriteOptions = WriteOptions(rawValue: 0b0000_0000_0000_0001)
-    static var CreateKeypaths                : WriteOptions = WriteOptions(rawValue: 0b0000_0000_0000_0010)
-    static var KeepComments                  : WriteOptions = WriteOptions(rawValue: 0b0000_0000_0000_0100)
-    static var IndentByDepth                 : WriteOptions = WriteOptions(rawValue: 0b0000_0000_0000_1000)
-    static var KeepOneLiners                 : WriteOptions = WriteOptions(rawValue: 0b0000_0000_0001_0000)
-    static var ForceOneLiners                : WriteOptions = WriteOptions(rawValue: 0b0000_0000_0010_0000)
-    static var BreakAfterLeftSquareBracket   : WriteOptions = WriteOptions(rawValue: 0b0000_0000_0100_0000)
-    static var BreakBeforeRightSquareBracket : WriteOptions = WriteOptions(rawValue: 0b0000_0000_1000_0000)
-    static var BreakInsideSquareBrackets     : WriteOptions = WriteOptions(rawValue: 0b0000_0000_1100_0000)
-    static var BreakAfterLeftCurlyBracket    : WriteOptions = WriteOptions(rawValue: 0b0000_0001_0000_0000)
-    static var BreakBeforeRightCurlyBracket  : WriteOptions = WriteOptions(rawValue: 0b0000_0010_0000_0000)
-    static var BreakInsideCurlyBrackets      : WriteOptions = WriteOptions(rawValue: 0b0000_0011_0000_0000)
-    static var BreakAfterComma               : WriteOptions = WriteOptions(rawValue: 0b0000_0100_0000_0000)
-    static var BreakBetweenColonAndArray     : WriteOptions = WriteOptions(rawValue: 0b0000_1000_0000_0000)
-    static var BreakBetweenColonAndObject    : WriteOptions = WriteOptions(rawValue: 0b0001_0000_0000_0000)
-    
+    public static var None                          : WriteOptions = WriteOptions(rawValue: 0b0000_0000_0000_0000)
+    public static var PreserveWhitespace            : WriteOptions = WriteOptions(rawValue: 0b0000_0000_0000_0001)
+    public static var CreateKeypaths                : WriteOptions = WriteOptions(rawValue: 0b0000_0000_0000_0010)
+    public static var KeepComments                  : WriteOptions = WriteOptions(rawValue: 0b0000_0000_0000_0100)
+    public static var IndentByDepth                 : WriteOptions = WriteOptions(rawValue: 0b0000_0000_0000_1000)
+    public static var KeepOneLiners                 : WriteOptions = WriteOptions(rawValue: 0b0000_0000_0001_0000)
+    public static var ForceOneLiners                : WriteOptions = WriteOptions(rawValue: 0b0000_0000_0010_0000)
+    public static var BreakAfterLeftSquareBracket   : WriteOptions = WriteOptions(rawValue: 0b0000_0000_0100_0000)
+    public static var BreakBeforeRightSquareBracket : WriteOptions = WriteOptions(rawValue: 0b0000_0000_1000_0000)
+    public static var BreakInsideSquareBrackets     : WriteOptions = WriteOptions(rawValue: 0b0000_0000_1100_0000)
+    public static var BreakAfterLeftCurlyBracket    : WriteOptions = WriteOptions(rawValue: 0b0000_0001_0000_0000)
+    public static var BreakBeforeRightCurlyBracket  : WriteOptions = WriteOptions(rawValue: 0b0000_0010_0000_0000)
+    public static var BreakInsideCurlyBrackets      : WriteOptions = WriteOptions(rawValue: 0b0000_0011_0000_0000)
+    public static var BreakAfterComma               : WriteOptions = WriteOptions(rawValue: 0b0000_0100_0000_0000)
+    public static var BreakBetweenColonAndArray     : WriteOptions = WriteOptions(rawValue: 0b0000_1000_0000_0000)
+    public static var BreakBetweenColonAndObject    : WriteOptions = WriteOptions(rawValue: 0b0001_0000_0000_0000)
+
+    /** The layout of `JSONValue.prettyRawValue` */
+    public static var Prettified                    : WriteOptions = WriteOptions.IndentByDepth
+                                                                   | WriteOptions.BreakInsideSquareBrackets
+                                                                   | WriteOptions.BreakInsideCurlyBrackets
+                                                                   | WriteOptions.BreakAfterComma
+
     public static var allZeros               : WriteOptions { return WriteOptions.None }
   }
   
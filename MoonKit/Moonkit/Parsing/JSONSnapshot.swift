@@ -0,0 +1,379 @@
+//
+//  JSONSnapshot.swift
+//  MoonKit
+//
+//  Created by Jason Cardwell on 6/16/15.
+//  Copyright (c) 2015 Jason Cardwell. All rights reserved.
+//
+
+import Foundation
+
+/**
+A compact binary form of a `JSONValue` tree that can be read back without any text scanning. Snapshots are derived
+from JSON text, which remains the source to edit. Each carries a hash of the text it was made from so that a stale
+snapshot can be recognized and replaced.
+
+Layout, all integers in the byte order of the device:
+
+header → 'MSJS' version:UInt32 sourceHash:UInt64 keyTableOffset:UInt32 value
+
+value → tag:UInt8 payload
+
+payload → nothing (null, false, true) | Int64 | Float64 | string | count:UInt32 value* | count:UInt32 (key:UInt32 value)*
+
+string → length:UInt32 UTF-8 bytes
+
+key table → count:UInt32 string*
+
+Object keys are indexes into the key table, which holds each distinct key once. Values are stored in the order of the
+records of a `JSONDocument` arena, which is what a snapshot is written from and decoded into.
+*/
+public final class JSONSnapshot {
+
+  /** The hash of the text from which the snapshot was made */
+  public let sourceHash: UInt64
+
+  /** The snapshot's bytes, mapped from its file when read with `init:contentsOfFile:error:` */
+  public let data: NSData
+
+  private let keys: [String]
+
+  static let Magic: [UInt8] = Array("MSJS".utf8)
+  static let Version: UInt32 = 1
+  static let HeaderSize = 20
+  static let ErrorDomain = "MSJSONSerializationErrorDomain"
+
+  private enum Tag: UInt8 { case Null, False, True, Integer, Double, String, Array, Object }
+
+  // MARK: - Reading
+
+  /**
+  Maps the snapshot at `path` into memory
+
+  :param: path String
+  :param: error NSErrorPointer = nil
+  */
+  public convenience init?(contentsOfFile path: String, error: NSErrorPointer = nil) {
+    let data = NSData(contentsOfFile: path, options: .DataReadingMappedAlways, error: error)
+    self.init(data: data ?? NSData(), error: data == nil ? nil : error)
+    if data == nil { return nil }
+  }
+
+  /**
+  Validates the header of the snapshot in `data` and reads its key table
+
+  :param: data NSData
+  :param: error NSErrorPointer = nil
+  */
+  public init?(data: NSData, error: NSErrorPointer = nil) {
+    self.data = data
+    var keys: [String] = []
+    var hash: UInt64 = 0
+    var keyTableOffset: UInt32 = 0
+    var valid = data.length >= JSONSnapshot.HeaderSize
+    if valid {
+      let bytes = UnsafePointer<UInt8>(data.bytes)
+      for i in 0 ..< JSONSnapshot.Magic.count { if bytes[i] != JSONSnapshot.Magic[i] { valid = false } }
+      var version: UInt32 = 0
+      memcpy(&version, bytes + 4, 4)
+      memcpy(&hash, bytes + 8, 8)
+      memcpy(&keyTableOffset, bytes + 16, 4)
+      valid = valid && version == JSONSnapshot.Version
+    }
+    var offset = Int(keyTableOffset)
+    if let count = valid ? JSONSnapshot.readUInt32(data, offset: &offset) : nil {
+      keys.reserveCapacity(Int(count))
+      for _ in 0 ..< count {
+        if let key = JSONSnapshot.readString(data, offset: &offset) { keys.append(key) } else { valid = false; break }
+      }
+    } else { valid = false }
+    self.keys = keys
+    sourceHash = hash
+    if !valid {
+      JSONSnapshot.setError(error, reason: "missing or malformed snapshot header")
+      return nil
+    }
+  }
+
+  /**
+  Decodes the snapshot into a `JSONDocument` that adopts the snapshot's key table
+
+  :param: options JSONSerialization.ReadOptions = .None Only `InflateKeypaths` applies
+  :param: error NSErrorPointer = nil
+
+  :returns: JSONDocument?
+  */
+  public func document(options: JSONSerialization.ReadOptions = .None, error: NSErrorPointer = nil) -> JSONDocument? {
+    let arena = JSONDocument.Arena(keys: keys)
+    var offset = JSONSnapshot.HeaderSize
+    if readValue(&offset, intoArena: arena) && arena.isComplete {
+      return JSONDocument(arena: arena, inflateKeypaths: hasOption(JSONSerialization.ReadOptions.InflateKeypaths, options))
+    }
+    JSONSnapshot.setError(error, reason: "malformed value near offset \(offset)")
+    return nil
+  }
+
+  /**
+  Decodes the snapshot's value
+
+  :param: error NSErrorPointer = nil
+
+  :returns: JSONValue?
+  */
+  public func value(error: NSErrorPointer = nil) -> JSONValue? { return document(error: error)?.root.jsonValue }
+
+  /**
+  Adds the value at `offset` and its descendants to `arena`
+
+  :param: offset Int
+  :param: arena JSONDocument.Arena
+
+  :returns: Bool Whether the value was well formed
+  */
+  private func readValue(inout offset: Int, intoArena arena: JSONDocument.Arena) -> Bool {
+    if offset >= data.length { return false }
+    if let tag = Tag(rawValue: UnsafePointer<UInt8>(data.bytes)[offset++]) {
+      switch tag {
+        case .Null:  arena.addNull()
+        case .False: arena.addBoolean(false)
+        case .True:  arena.addBoolean(true)
+
+        case .Integer:
+          var integer: Int64 = 0
+          if !JSONSnapshot.readBytes(&integer, data: data, offset: &offset, length: 8) { return false }
+          arena.addNumber(NSNumber(longLong: integer))
+
+        case .Double:
+          var double: Double = 0
+          if !JSONSnapshot.readBytes(&double, data: data, offset: &offset, length: 8) { return false }
+          arena.addNumber(NSNumber(double: double))
+
+        case .String:
+          if let string = JSONSnapshot.readString(data, offset: &offset) { arena.addString(string) } else { return false }
+
+        case .Array, .Object:
+          if let count = JSONSnapshot.readUInt32(data, offset: &offset) {
+            arena.beginContainer(tag == .Object ? .Object : .Array)
+            for _ in 0 ..< count {
+              if tag == .Object {
+                if let index = JSONSnapshot.readUInt32(data, offset: &offset) where Int(index) < keys.count {
+                  arena.addKeyIndex(Int32(index))
+                } else { return false }
+              }
+              if !readValue(&offset, intoArena: arena) { return false }
+            }
+            arena.endContainer()
+          } else { return false }
+      }
+      return true
+    } else { return false }
+  }
+
+  /**
+  Copies `length` bytes at `offset` into `destination` and advances `offset` when they are within `data`
+
+  :param: destination UnsafeMutablePointer<Void>
+  :param: data NSData
+  :param: offset Int
+  :param: length Int
+
+  :returns: Bool
+  */
+  private static func readBytes(destination: UnsafeMutablePointer<Void>,
+                                data: NSData,
+                                inout offset: Int,
+                                length: Int) -> Bool
+  {
+    if offset < 0 || offset + length > data.length { return false }
+    memcpy(destination, UnsafePointer<UInt8>(data.bytes) + offset, length)
+    offset += length
+    return true
+  }
+
+  /**
+  readUInt32:offset:
+
+  :param: data NSData
+  :param: offset Int
+
+  :returns: UInt32?
+  */
+  private static func readUInt32(data: NSData, inout offset: Int) -> UInt32? {
+    var value: UInt32 = 0
+    return readBytes(&value, data: data, offset: &offset, length: 4) ? value : nil
+  }
+
+  /**
+  readString:offset:
+
+  :param: data NSData
+  :param: offset Int
+
+  :returns: String?
+  */
+  private static func readString(data: NSData, inout offset: Int) -> String? {
+    if let length = readUInt32(data, offset: &offset) where offset + Int(length) <= data.length {
+      let bytes = UnsafePointer<UInt8>(data.bytes) + offset
+      let string = NSString(bytes: bytes, length: Int(length), encoding: NSUTF8StringEncoding) as? String
+      offset += Int(length)
+      return string
+    } else { return nil }
+  }
+
+  /**
+  setError:reason:
+
+  :param: error NSErrorPointer
+  :param: reason String
+  */
+  private static func setError(error: NSErrorPointer, reason: String) {
+    if error != nil {
+      error.memory = NSError(domain: ErrorDomain,
+                             code: NSFileReadCorruptFileError,
+                             userInfo: [NSLocalizedFailureReasonErrorKey: reason])
+    }
+  }
+
+  // MARK: - Writing
+
+  /**
+  The snapshot of `document`. Records are written in the order the arena holds them and the key table is the
+  document's own, so no tree is walked or rebuilt.
+
+  :param: document JSONDocument
+  :param: sourceHash UInt64 = 0
+
+  :returns: NSData
+  */
+  public static func dataWithDocument(document: JSONDocument, sourceHash: UInt64 = 0) -> NSData {
+    let data = NSMutableData()
+    data.appendBytes(Magic, length: Magic.count)
+    var version = Version, hash = sourceHash, keyTableOffset: UInt32 = 0
+    data.appendBytes(&version, length: 4)
+    data.appendBytes(&hash, length: 8)
+    data.appendBytes(&keyTableOffset, length: 4)
+
+    let arena = document.arena
+    for record in arena.records {
+      if record.key >= 0 { var key = UInt32(record.key); data.appendBytes(&key, length: 4) }
+      switch record.kind {
+        case .Null:    appendTag(.Null, toData: data)
+        case .Boolean: appendTag(record.payload != 0 ? .True : .False, toData: data)
+
+        case .Number:
+          let number = arena.numbers[Int(record.payload)]
+          if CFNumberIsFloatType(number) != 0 {
+            var double = number.doubleValue
+            appendTag(.Double, toData: data)
+            data.appendBytes(&double, length: 8)
+          } else {
+            var integer = number.longLongValue
+            appendTag(.Integer, toData: data)
+            data.appendBytes(&integer, length: 8)
+          }
+
+        case .String:
+          appendTag(.String, toData: data)
+          var length = UInt32(record.count)
+          data.appendBytes(&length, length: 4)
+          arena.bytes.withUnsafeBufferPointer {
+            data.appendBytes($0.baseAddress + Int(record.payload), length: Int(record.count))
+          }
+
+        case .Array, .Object:
+          appendTag(record.kind == .Object ? .Object : .Array, toData: data)
+          var count = UInt32(record.count)
+          data.appendBytes(&count, length: 4)
+      }
+    }
+
+    keyTableOffset = UInt32(data.length)
+    data.replaceBytesInRange(NSRange(location: 16, length: 4), withBytes: &keyTableOffset)
+    var count = UInt32(arena.keys.count)
+    data.appendBytes(&count, length: 4)
+    for key in arena.keys {
+      let bytes = Array(key.utf8)
+      var length = UInt32(bytes.count)
+      data.appendBytes(&length, length: 4)
+      data.appendBytes(bytes, length: bytes.count)
+    }
+    return data
+  }
+
+  /**
+  The snapshot of `value`
+
+  :param: value JSONValue
+  :param: sourceHash UInt64 = 0
+
+  :returns: NSData
+  */
+  public static func dataWithValue(value: JSONValue, sourceHash: UInt64 = 0) -> NSData {
+    return dataWithDocument(JSONDocument(value), sourceHash: sourceHash)
+  }
+
+  /**
+  Writes the snapshot of `document` to `path`
+
+  :param: document JSONDocument
+  :param: path String
+  :param: sourceHash UInt64 = 0
+  :param: error NSErrorPointer = nil
+
+  :returns: Bool
+  */
+  public static func writeDocument(document: JSONDocument,
+                            toFile path: String,
+                            sourceHash: UInt64 = 0,
+                                 error: NSErrorPointer = nil) -> Bool
+  {
+    return dataWithDocument(document, sourceHash: sourceHash).writeToFile(path, options: .DataWritingAtomic, error: error)
+  }
+
+  /**
+  Writes the snapshot of `value` to `path`
+
+  :param: value JSONValue
+  :param: path String
+  :param: sourceHash UInt64 = 0
+  :param: error NSErrorPointer = nil
+
+  :returns: Bool
+  */
+  public static func writeValue(value: JSONValue,
+                         toFile path: String,
+                         sourceHash: UInt64 = 0,
+                              error: NSErrorPointer = nil) -> Bool
+  {
+    return writeDocument(JSONDocument(value), toFile: path, sourceHash: sourceHash, error: error)
+  }
+
+  /**
+  appendTag:toData:
+
+  :param: tag Tag
+  :param: data NSMutableData
+  */
+  private static func appendTag(tag: Tag, toData data: NSMutableData) {
+    var rawTag = tag.rawValue
+    data.appendBytes(&rawTag, length: 1)
+  }
+
+  // MARK: - Source hashing
+
+  /**
+  FNV-1a hash of the bytes of `data`, used to tie a snapshot to the text it was made from
+
+  :param: data NSData
+  :param: seed UInt64 = 0 Mixed in before the bytes, i.e. read options that shaped the value
+
+  :returns: UInt64
+  */
+  public static func hashData(data: NSData, seed: UInt64 = 0) -> UInt64 {
+    var hash: UInt64 = 14695981039346656037 ^ seed
+    let bytes = UnsafePointer<UInt8>(data.bytes)
+    for i in 0 ..< data.length { hash = (hash ^ UInt64(bytes[i])) &* 1099511628211 }
+    return hash
+  }
+
+}
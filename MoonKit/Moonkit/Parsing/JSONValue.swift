@@ -113,49 +113,10 @@ public enum JSONValue {
     } else { return nil }
   }
 
-  /**
-  stringValueWithDepth:
-
-  :param: depth Int
-
-  :returns: Swift.String
-  */
-  private func stringValueWithDepth(depth: Int) -> Swift.String {
-    switch self {
-      case .Boolean(_),
-           .Null(_),
-           .Number(_),
-           .String(_):
-        return rawValue
-
-      case .Array(let a):
-        let outerIndent = " " * (depth * 4)
-        let innerIndent = outerIndent + " " * 4
-        var string = "["
-        let elements = a.map({$0.stringValueWithDepth(depth + 1)})
-        switch elements.count {
-          case 0: string += "]"
-          case 1: string += "\n\(innerIndent)" + elements[0] + "\n\(outerIndent)]"
-          default: string += "\n\(innerIndent)" + ",\n\(innerIndent)".join(elements) + "\n\(outerIndent)]"
-        }
-        return string
-
-      case .Object(let o):
-        let outerIndent = " " * (depth * 4)
-        let innerIndent = outerIndent + " " * 4
-        var string = "{"
-        let keyValuePairs = o.map({"\"\($1)\": \($2.stringValueWithDepth(depth + 1))"}).values.array
-        switch keyValuePairs.count {
-          case 0: string += "]"
-          case 1: string += "\n\(innerIndent)" + keyValuePairs[0] + "\n\(outerIndent)}"
-          default: string += "\n\(innerIndent)" + ",\n\(innerIndent)".join(keyValuePairs) + "\n\(outerIndent)}"
-        }
-        return string
-    }
-  }
-
   /** The formatted JSONValue string representation */
-  public var prettyRawValue: Swift.String { return stringValueWithDepth(0) }
+  public var prettyRawValue: Swift.String {
+    return JSONWriter.stringWithValue(self, options: JSONSerialization.WriteOptions.Prettified)
+  }
 
   /** An object representation of the value */
   public var anyObjectValue: AnyObject {
@@ -0,0 +1,308 @@
+//
+//  JSONWriter.swift
+//  MoonKit
+//
+//  Created by Jason Cardwell on 6/14/15.
+//  Copyright (c) 2015 Jason Cardwell. All rights reserved.
+//
+
+import Foundation
+
+/**
+Writes JSON text to an output stream as values are handed to it. Output passes through a fixed size buffer so memory
+use does not grow with the size of the document, containers may be opened and closed incrementally so that large
+collections never need to exist as a single `JSONValue`.
+
+Formatting follows the `JSONSerialization.WriteOptions` flags. `PreserveWhitespace` and `KeepComments` describe source
+text that a `JSONValue` does not retain and are ignored. Like `rawValue`, strings and keys are written verbatim.
+*/
+public final class JSONWriter {
+
+  public let options: JSONSerialization.WriteOptions
+
+  /** The first error reported by the stream, nothing is written once set */
+  public private(set) var error: NSError?
+
+  private let stream: NSOutputStream
+  private var buffer: [UInt8] = []
+  private var closed = false
+
+  static let BufferSize = 4096
+
+  private struct Container {
+    let isObject: Bool
+    let isOneLiner: Bool
+    var count = 0
+    init(isObject: Bool, isOneLiner: Bool) { self.isObject = isObject; self.isOneLiner = isOneLiner }
+  }
+
+  /** Open containers, innermost last */
+  private var containers: [Container] = []
+
+  /** Whether a key has been written that still awaits its value */
+  private var expectingValue = false
+
+  private var rootWritten = false
+
+  /**
+  Initialize with the stream to write to, the stream is opened if necessary
+
+  :param: stream NSOutputStream
+  :param: options JSONSerialization.WriteOptions = .None
+  */
+  public init(stream: NSOutputStream, options: JSONSerialization.WriteOptions = .None) {
+    self.stream = stream
+    self.options = options
+    buffer.reserveCapacity(JSONWriter.BufferSize)
+    if stream.streamStatus == .NotOpen { stream.open() }
+  }
+
+  /**
+  A writer that replaces the content of the file at `path`
+
+  :param: path String
+  :param: options JSONSerialization.WriteOptions = .None
+
+  :returns: JSONWriter?
+  */
+  public class func writerForFileAtPath(path: String, options: JSONSerialization.WriteOptions = .None) -> JSONWriter? {
+    let stream: NSOutputStream? = NSOutputStream(toFileAtPath: path, append: false)
+    if stream == nil { return nil }
+    let writer = JSONWriter(stream: stream!, options: options)
+    return writer.error == nil && stream!.streamStatus != .Error ? writer : nil
+  }
+
+  /**
+  The text written for `value`
+
+  :param: value JSONValue
+  :param: options JSONSerialization.WriteOptions = .None
+
+  :returns: String
+  */
+  public class func stringWithValue(value: JSONValue, options: JSONSerialization.WriteOptions = .None) -> String {
+    let stream = NSOutputStream.outputStreamToMemory()
+    let writer = JSONWriter(stream: stream, options: options)
+    writer.writeValue(value)
+    writer.flush()
+    let data = stream.propertyForKey(NSStreamDataWrittenToMemoryStreamKey) as? NSData
+    writer.close()
+    if data == nil { return "" }
+    return (NSString(data: data!, encoding: NSUTF8StringEncoding) as? String) ?? ""
+  }
+
+  deinit { close() }
+
+  // MARK: - Writing values
+
+  /**
+  Writes `value` in its entirety, as the next element, the value for the last key, or the root value
+
+  :param: value JSONValue
+  */
+  public func writeValue(value: JSONValue) {
+    switch value {
+      case .Array(let a):
+        beginArray(isOneLiner: isOneLiner(a))
+        for element in a { writeValue(element) }
+        endArray()
+
+      case .Object(let o):
+        beginObject(isOneLiner: isOneLiner(o.values.array))
+        for i in 0 ..< o.count {
+          let member = hasOption(JSONSerialization.WriteOptions.CreateKeypaths, options)
+                         ? collapsedMember(o[i].1, value: o[i].2)
+                         : (o[i].1, o[i].2)
+          writeKey(member.0)
+          writeValue(member.1)
+        }
+        endObject()
+
+      default:
+        beginValue(isArray: false, isObject: false)
+        writeString(value.rawValue)
+    }
+  }
+
+  /** Opens an array, elements are written with `writeValue:` and nested containers until `endArray` */
+  public func beginArray() { beginArray(isOneLiner: false) }
+
+  /** Closes the innermost container, which must be an array */
+  public func endArray() {
+    assert(containers.last?.isObject == false, "no open array to end")
+    endContainer("]", breakBefore: JSONSerialization.WriteOptions.BreakBeforeRightSquareBracket)
+  }
+
+  /** Opens an object, members are written as `writeKey:` followed by their value until `endObject` */
+  public func beginObject() { beginObject(isOneLiner: false) }
+
+  /** Closes the innermost container, which must be an object with no key awaiting its value */
+  public func endObject() {
+    assert(containers.last?.isObject == true && !expectingValue, "no open object to end")
+    endContainer("}", breakBefore: JSONSerialization.WriteOptions.BreakBeforeRightCurlyBracket)
+  }
+
+  /**
+  Writes the key of the next member of the innermost object
+
+  :param: key String
+  */
+  public func writeKey(key: String) {
+    assert(containers.last?.isObject == true && !expectingValue, "a key must be written inside an object before its value")
+    beginMember(JSONSerialization.WriteOptions.BreakAfterLeftCurlyBracket)
+    writeString("\"")
+    writeString(key)
+    writeString("\":")
+    expectingValue = true
+  }
+
+  /** Writes any buffered output to the stream */
+  public func flush() {
+    if buffer.isEmpty || error != nil { buffer.removeAll(keepCapacity: true); return }
+    var written = 0
+    buffer.withUnsafeBufferPointer {
+      (pointer: UnsafeBufferPointer<UInt8>) -> Void in
+      while written < pointer.count {
+        let result = self.stream.write(pointer.baseAddress + written, maxLength: pointer.count - written)
+        if result <= 0 {
+          self.error = self.stream.streamError
+                         ?? NSError(domain: "MSJSONSerializationErrorDomain", code: NSFileWriteUnknownError, userInfo: nil)
+          break
+        }
+        written += result
+      }
+    }
+    buffer.removeAll(keepCapacity: true)
+  }
+
+  /** Flushes the buffer and closes the stream, the writer cannot be used afterwards */
+  public func close() {
+    if closed { return }
+    assert(containers.isEmpty || error != nil, "closing writer with open containers")
+    flush()
+    stream.close()
+    closed = true
+  }
+
+  // MARK: - Formatting
+
+  /**
+  Whether a container with `values` is kept on one line
+
+  :param: values [JSONValue]
+
+  :returns: Bool
+  */
+  private func isOneLiner(values: [JSONValue]) -> Bool {
+    let scalars = values.filter({ switch $0 { case .Array, .Object: return false; default: return true } })
+    if scalars.count != values.count { return false }
+    if hasOption(JSONSerialization.WriteOptions.ForceOneLiners, options) { return true }
+    return hasOption(JSONSerialization.WriteOptions.KeepOneLiners, options) && values.count < 2
+  }
+
+  /**
+  Folds objects that hold a single member into the member's key, `{"a": {"b": 1}}` becomes `{"a.b": 1}`
+
+  :param: key String
+  :param: value JSONValue
+
+  :returns: (String, JSONValue)
+  */
+  private func collapsedMember(key: String, value: JSONValue) -> (String, JSONValue) {
+    switch value {
+      case .Object(let o) where o.count == 1: return collapsedMember("\(key).\(o[0].1)", value: o[0].2)
+      default: return (key, value)
+    }
+  }
+
+  private func beginArray(#isOneLiner: Bool) {
+    beginValue(isArray: true, isObject: false)
+    writeString("[")
+    containers.append(Container(isObject: false, isOneLiner: isOneLiner))
+  }
+
+  private func beginObject(#isOneLiner: Bool) {
+    beginValue(isArray: false, isObject: true)
+    writeString("{")
+    containers.append(Container(isObject: true, isOneLiner: isOneLiner))
+  }
+
+  /**
+  Writes what separates a value from whatever precedes it
+
+  :param: isArray Bool
+  :param: isObject Bool
+  */
+  private func beginValue(#isArray: Bool, isObject: Bool) {
+    if expectingValue {
+      expectingValue = false
+      if isArray && hasOption(JSONSerialization.WriteOptions.BreakBetweenColonAndArray, options)
+        || isObject && hasOption(JSONSerialization.WriteOptions.BreakBetweenColonAndObject, options)
+      {
+        writeLineBreak(containers.count)
+      } else if isPretty { writeString(" ") }
+    } else if containers.isEmpty {
+      assert(!rootWritten, "a document holds a single root value")
+      rootWritten = true
+    } else {
+      assert(!containers[containers.count - 1].isObject, "an object member must begin with its key")
+      beginMember(JSONSerialization.WriteOptions.BreakAfterLeftSquareBracket)
+    }
+  }
+
+  /**
+  Writes the comma and any break that precede the next member of the innermost container. The break following an
+  opening bracket is written here rather than with the bracket so that empty containers stay `[]` and `{}`.
+
+  :param: breakAfterBracket JSONSerialization.WriteOptions
+  */
+  private func beginMember(breakAfterBracket: JSONSerialization.WriteOptions) {
+    let container = containers[containers.count - 1]
+    if container.count > 0 { writeString(",") }
+    if container.isOneLiner { if container.count > 0 { writeString(" ") } }
+    else if hasOption(container.count == 0 ? breakAfterBracket : JSONSerialization.WriteOptions.BreakAfterComma, options) {
+      writeLineBreak(containers.count)
+    }
+    containers[containers.count - 1].count++
+  }
+
+  /**
+  endContainer:breakBefore:
+
+  :param: bracket String
+  :param: breakBefore JSONSerialization.WriteOptions
+  */
+  private func endContainer(bracket: String, breakBefore: JSONSerialization.WriteOptions) {
+    let container = containers.removeLast()
+    if container.count > 0 && !container.isOneLiner && hasOption(breakBefore, options) {
+      writeLineBreak(containers.count)
+    }
+    writeString(bracket)
+  }
+
+  /** Whether a space follows colons, which is the case whenever the output is indented */
+  private var isPretty: Bool { return hasOption(JSONSerialization.WriteOptions.IndentByDepth, options) }
+
+  /**
+  writeLineBreak:
+
+  :param: depth Int
+  */
+  private func writeLineBreak(depth: Int) {
+    writeString("\n")
+    if isPretty { writeString(" " * (depth * 4)) }
+  }
+
+  /**
+  writeString:
+
+  :param: string String
+  */
+  private func writeString(string: String) {
+    for byte in string.utf8 {
+      buffer.append(byte)
+      if buffer.count == JSONWriter.BufferSize { flush() }
+    }
+  }
+
+}
@@ -0,0 +1,269 @@
+//
+//  Beacon.swift
+//  Remote
+//
+//  Created by Jason Cardwell on 5/23/15.
+//  Copyright (c) 2015 Moondeer Studios. All rights reserved.
+//
+
+import Foundation
+import MoonKit
+
+/**
+An AMXB or SSDP beacon located within the datagram that carried it. Parsing scans the raw bytes once and records
+ranges and a hash of the identifier, strings are only created when a field is read.
+*/
+struct Beacon {
+
+  enum Kind { case AMXB, SSDP }
+
+  let kind: Kind
+  let data: NSData
+
+  /** `UUID` of an AMXB beacon or the `uuid:` part of an SSDP beacon's `USN`, its `LOCATION` when there is no `USN` */
+  let identifierRange: NSRange
+
+  /** Range of an SSDP beacon's `LOCATION` */
+  let locationRange: NSRange?
+
+  /** FNV-1a hash of the identifier's bytes */
+  let identifierHash: Int
+
+  var identifier: String { return Beacon.stringWithBytes(data, range: identifierRange) }
+  var location: String? { return locationRange == nil ? nil : Beacon.stringWithBytes(data, range: locationRange!) }
+  var message: String { return (NSString(data: data, encoding: NSUTF8StringEncoding) as? String) ?? "" }
+
+  private static let AMXBPrefix = Array("AMXB".utf8)
+  private static let UUIDKey = Array("<-UUID=".utf8)
+  private static let LocationHeader = Array("location:".utf8)
+  private static let USNHeader = Array("usn:".utf8)
+  private static let USNSeparator = Array("::".utf8)
+
+  /**
+  Locates the fields of the beacon in `data`, fails for datagrams that are neither AMXB nor SSDP beacons with an
+  identifier
+
+  :param: data NSData
+  */
+  init?(data: NSData) {
+    let bytes = UnsafePointer<UInt8>(data.bytes)
+    let length = data.length
+    self.data = data
+
+    if Beacon.bytes(bytes, length: length, haveCaseInsensitivePrefix: Beacon.AMXBPrefix) {
+      kind = .AMXB
+      locationRange = nil
+      if let start = Beacon.indexOfBytes(Beacon.UUIDKey, inBytes: bytes, from: 0, to: length),
+        end = Beacon.indexOfByte(UInt8(ascii: ">"), inBytes: bytes, from: start + Beacon.UUIDKey.count, to: length)
+      {
+        let location = start + Beacon.UUIDKey.count
+        identifierRange = NSRange(location: location, length: end - location)
+      } else { return nil }
+    } else {
+      kind = .SSDP
+      var location: NSRange?
+      var usn: NSRange?
+      var lineStart = 0
+      while lineStart < length {
+        let lineEnd = Beacon.indexOfByte(NetworkDeviceConnection.LF, inBytes: bytes, from: lineStart, to: length) ?? length
+        if let value = Beacon.valueOfHeader(Beacon.LocationHeader, inBytes: bytes, from: lineStart, to: lineEnd) {
+          location = value
+        } else if let value = Beacon.valueOfHeader(Beacon.USNHeader, inBytes: bytes, from: lineStart, to: lineEnd) {
+          usn = value
+        }
+        lineStart = lineEnd + 1
+      }
+      locationRange = location
+      if let usn = usn {
+        // Services of a device share its uuid, only the part before the service type identifies the device
+        let end = Beacon.indexOfBytes(Beacon.USNSeparator, inBytes: bytes, from: usn.location, to: NSMaxRange(usn))
+        identifierRange = NSRange(location: usn.location, length: (end ?? NSMaxRange(usn)) - usn.location)
+      } else if let location = location {
+        identifierRange = location
+      } else { return nil }
+    }
+
+    identifierHash = Beacon.hashBytes(bytes + identifierRange.location, length: identifierRange.length)
+  }
+
+  // MARK: - Scanning
+
+  /**
+  FNV-1a hash of the bytes
+
+  :param: bytes UnsafePointer<UInt8>
+  :param: length Int
+
+  :returns: Int
+  */
+  static func hashBytes(bytes: UnsafePointer<UInt8>, length: Int) -> Int {
+    var hash: UInt64 = 14695981039346656037
+    for i in 0 ..< length { hash = (hash ^ UInt64(bytes[i])) &* 1099511628211 }
+    return Int(truncatingBitPattern: hash)
+  }
+
+  /**
+  Whether the bytes begin with `prefix`, ignoring the case of ASCII letters
+
+  :param: bytes UnsafePointer<UInt8>
+  :param: length Int
+  :param: prefix [UInt8] Lowercase
+  */
+  private static func bytes(bytes: UnsafePointer<UInt8>, length: Int, haveCaseInsensitivePrefix prefix: [UInt8]) -> Bool {
+    if length < prefix.count { return false }
+    for i in 0 ..< prefix.count { if bytes[i] | 0x20 != prefix[i] | 0x20 { return false } }
+    return true
+  }
+
+  /**
+  indexOfByte:inBytes:from:to:
+
+  :param: byte UInt8
+  :param: bytes UnsafePointer<UInt8>
+  :param: from Int
+  :param: to Int
+
+  :returns: Int?
+  */
+  private static func indexOfByte(byte: UInt8, inBytes bytes: UnsafePointer<UInt8>, from: Int, to: Int) -> Int? {
+    for i in from ..< max(from, to) { if bytes[i] == byte { return i } }
+    return nil
+  }
+
+  /**
+  indexOfBytes:inBytes:from:to:
+
+  :param: pattern [UInt8]
+  :param: bytes UnsafePointer<UInt8>
+  :param: from Int
+  :param: to Int
+
+  :returns: Int?
+  */
+  private static func indexOfBytes(pattern: [UInt8], inBytes bytes: UnsafePointer<UInt8>, from: Int, to: Int) -> Int? {
+    if to - from < pattern.count { return nil }
+    outer: for i in from ... to - pattern.count {
+      for j in 0 ..< pattern.count { if bytes[i + j] != pattern[j] { continue outer } }
+      return i
+    }
+    return nil
+  }
+
+  /**
+  Range of the value of the line's header when the line is the header named by `header`, whitespace and the line's
+  terminator excluded
+
+  :param: header [UInt8] Lowercase name including the colon
+  :param: bytes UnsafePointer<UInt8>
+  :param: from Int Start of the line
+  :param: to Int End of the line
+
+  :returns: NSRange?
+  */
+  private static func valueOfHeader(header: [UInt8], inBytes bytes: UnsafePointer<UInt8>, from: Int, to: Int) -> NSRange? {
+    if !Beacon.bytes(bytes + from, length: to - from, haveCaseInsensitivePrefix: header) { return nil }
+    var start = from + header.count
+    var end = to
+    while start < end && (bytes[start] == 0x20 || bytes[start] == 0x09) { start++ }
+    while end > start && (bytes[end - 1] == 0x20 || bytes[end - 1] == NetworkDeviceConnection.CR) { end-- }
+    return NSRange(location: start, length: end - start)
+  }
+
+  /**
+  stringWithBytes:range:
+
+  :param: data NSData
+  :param: range NSRange
+
+  :returns: String
+  */
+  private static func stringWithBytes(data: NSData, range: NSRange) -> String {
+    let bytes = UnsafePointer<UInt8>(data.bytes) + range.location
+    return (NSString(bytes: bytes, length: range.length, encoding: NSUTF8StringEncoding) as? String) ?? ""
+  }
+
+}
+
+/**
+Screens datagrams before they are parsed and beacons before they are delivered. Each source may send at most
+`maxBeaconsPerSecond` datagrams per second on average with bursts of `burst`, the rest are dropped unread. A beacon whose
+identifier was delivered less than `duplicateInterval` seconds ago is dropped as well.
+*/
+struct BeaconFilter {
+
+  var duplicateInterval: NSTimeInterval = 60
+  var maxBeaconsPerSecond: Double = 2
+  var burst: Double = 4
+
+  /** Entries kept before stale ones are pruned */
+  static let PruneThreshold = 256
+
+  /** Times at which beacons were delivered keyed by identifier hash */
+  private var deliveryTimes: [Int:NSTimeInterval] = [:]
+
+  /** Token buckets keyed by source address hash */
+  private var tokens: [Int:Double] = [:]
+  private var tokenTimes: [Int:NSTimeInterval] = [:]
+
+  /**
+  Takes a token from the source's bucket
+
+  :param: address NSData The source's `sockaddr`
+  :param: now NSTimeInterval = CFAbsoluteTimeGetCurrent()
+
+  :returns: Bool Whether the datagram should be read
+  */
+  mutating func admitDatagramFromAddress(address: NSData, now: NSTimeInterval = CFAbsoluteTimeGetCurrent()) -> Bool {
+    let source = Beacon.hashBytes(UnsafePointer<UInt8>(address.bytes), length: address.length)
+    let elapsed = now - (tokenTimes[source] ?? now)
+    let available = min(burst, (tokens[source] ?? burst) + elapsed * maxBeaconsPerSecond)
+    tokenTimes[source] = now
+    if available < 1 { tokens[source] = available; return false }
+    tokens[source] = available - 1
+    if tokens.count > BeaconFilter.PruneThreshold { pruneTokens(now) }
+    return true
+  }
+
+  /**
+  Records the delivery of `beacon` unless its identifier was delivered within `duplicateInterval`
+
+  :param: beacon Beacon
+  :param: now NSTimeInterval = CFAbsoluteTimeGetCurrent()
+
+  :returns: Bool Whether the beacon should be delivered
+  */
+  mutating func admitBeacon(beacon: Beacon, now: NSTimeInterval = CFAbsoluteTimeGetCurrent()) -> Bool {
+    if let time = deliveryTimes[beacon.identifierHash] where now - time < duplicateInterval { return false }
+    deliveryTimes[beacon.identifierHash] = now
+    if deliveryTimes.count > BeaconFilter.PruneThreshold { pruneDeliveryTimes(now) }
+    return true
+  }
+
+  /** Forgets every delivery and source so that the next beacon from each is admitted */
+  mutating func reset() {
+    deliveryTimes.removeAll(keepCapacity: true)
+    tokens.removeAll(keepCapacity: true)
+    tokenTimes.removeAll(keepCapacity: true)
+  }
+
+  /**
+  Drops buckets that have refilled, they are indistinguishable from a new source
+
+  :param: now NSTimeInterval
+  */
+  private mutating func pruneTokens(now: NSTimeInterval) {
+    for (source, time) in tokenTimes {
+      if (now - time) * maxBeaconsPerSecond >= burst { tokens[source] = nil; tokenTimes[source] = nil }
+    }
+  }
+
+  /**
+  Drops deliveries older than `duplicateInterval`
+
+  :param: now NSTimeInterval
+  */
+  private mutating func pruneDeliveryTimes(now: NSTimeInterval) {
+    for (identifier, time) in deliveryTimes { if now - time >= duplicateInterval { deliveryTimes[identifier] = nil } }
+  }
+
+}
@@ -15,6 +15,19 @@ import class DataModel.ITachIRCommand
 import class DataModel.NetworkDevice
 import class DataModel.ITachDevice
 import class DataModel.HTTPCommand
+import class DataModel.ISYDevice
+import class DataModel.Activity
+import class DataModel.RemoteElement
+import class DataModel.Remote
+import class DataModel.ButtonGroup
+import class DataModel.Button
+import class DataModel.CommandSet
+import class DataModel.CommandSetCollection
+import class DataModel.Command
+import class DataModel.SendCommand
+import class DataModel.MacroCommand
+import class DataModel.PowerCommand
+import class DataModel.ActivityCommand
 
 /** The `ConnectionManager` class oversee all device-related network activity. */
 @objc public final class ConnectionManager {
@@ -24,6 +37,9 @@ import class DataModel.HTTPCommand
     SettingsManager.registerBoolSettingWithKey(AutoConnectDiscoveredKey, withDefaultValue: false)
     SettingsManager.registerBoolSettingWithKey(StopAfterUpdatedDeviceKey, withDefaultValue: true)
     SettingsManager.registerBoolSettingWithKey(StopAfterUpdatedDeviceKey, withDefaultValue: false)
+    SendCommand.sender = {
+      ConnectionManager.sendCommandWithID($0, priority: $1 ? .Macro : .Interactive, completion: $2)
+    }
   }
 
   public typealias Callback = (Bool, NSError?) -> Void
@@ -41,6 +57,8 @@ import class DataModel.HTTPCommand
     case ConnectionInProgress
     case NetworkDeviceError
     case Aggregate
+    case ResponseTimeout
+    case QueueFull
 
     static let domain = "ConnectionManagerErrorDomain"
 
@@ -56,6 +74,20 @@ import class DataModel.HTTPCommand
     }
   }
 
+  // MARK: - Message priorities
+
+  /**
+  Lanes in which device messages wait to be sent. Interactive messages come from button presses, macro messages from
+  macros working through their commands, and maintenance messages from discovery and learner control.
+  */
+  public enum Priority: Int {
+    case Interactive
+    case Macro
+    case Maintenance
+
+    static let allValues: [Priority] = [.Interactive, .Macro, .Maintenance]
+  }
+
   // MARK: - Flag, notification, and key property declarations
 
   /** Whether to simulate send operations */
@@ -82,8 +114,10 @@ import class DataModel.HTTPCommand
   /** Monitors changes in connectivity */
   private static let reachability = MSNetworkReachability(callback: {[cm = ConnectionManager.self]
     (flags: SCNetworkReachabilityFlags) -> Void in
+      let available = cm.flagsIndicateWifiAvailable(flags)
+      cm.cacheWifiAvailable(available)
       let name = cm.ConnectionStatusNotification
-      let userInfo: [NSObject:AnyObject] = [cm.WifiAvailableKey: cm.flagsIndicateWifiAvailable(flags)]
+      let userInfo: [NSObject:AnyObject] = [cm.WifiAvailableKey: available]
       NSNotificationCenter.defaultCenter().postNotificationName(name, object: cm, userInfo: userInfo)
       MSLogDebug("posted notification for changes in reachability")
     })
@@ -100,10 +134,28 @@ import class DataModel.HTTPCommand
          && ((flags & UInt32(kSCNetworkReachabilityFlagsReachable)) != 0))
   }
 
-  /** Indicates wifi availability */
+  /** Wifi availability last reported by `reachability`, `-1` until the flags have been read once */
+  private static var cachedWifiAvailability: Int32 = -1
+
+  /**
+  Stores the availability so that it is visible to every thread before the reachability callback returns
+
+  :param: available Bool
+  */
+  private static func cacheWifiAvailable(available: Bool) {
+    let value: Int32 = available ? 1 : 0
+    var cached: Int32
+    do { cached = cachedWifiAvailability } while !OSAtomicCompareAndSwap32Barrier(cached, value, &cachedWifiAvailability)
+  }
+
+  /**
+  Indicates wifi availability. Reads the availability cached from the reachability callback, the flags are only queried
+  directly the first time through.
+  */
   public static var wifiAvailable: Bool {
-    reachability.refreshFlags()
-    return flagsIndicateWifiAvailable(reachability.flags)
+    OSMemoryBarrier()
+    if cachedWifiAvailability == -1 { reachability.refreshFlags() }
+    return cachedWifiAvailability == 1
   }
 
   // MARK: - Background, foreground receptionists
@@ -122,7 +174,13 @@ import class DataModel.HTTPCommand
                      forObject: UIApplication.sharedApplication(),
               notificationName: UIApplicationWillEnterForegroundNotification,
                          queue: NSOperationQueue.mainQueue(),
-                       handler: {_ in ITachConnectionManager.resume(); ISYConnectionManager.resume()})
+                       handler: {_ in
+                        // Changes while suspended may not have been delivered, so the cache is refreshed here rather
+                        // than on the next send
+                        ConnectionManager.reachability.refreshFlags()
+                        ITachConnectionManager.resume()
+                        ISYConnectionManager.resume()
+                       })
 
 
   // MARK: - Sending commands
@@ -131,9 +189,13 @@ import class DataModel.HTTPCommand
   Executes the send operation, and, optionally, calls the completion handler with the result.
 
   :param: commandID NSManagedObjectID ID of the command to send
+  :param: priority Priority = .Interactive Lane in which the command waits to be sent
   :param: completion Callback? = nil Block to be executed upon completion of the send operation
   */
-  public static func sendCommandWithID(commandID: NSManagedObjectID, completion: Callback? = nil) {
+  public static func sendCommandWithID(commandID: NSManagedObjectID,
+                              priority: Priority = .Interactive,
+                            completion: Callback? = nil)
+  {
     MSLogInfo("sending command…")
 
     let simulateSuccess: () -> Void = {
@@ -152,13 +214,16 @@ import class DataModel.HTTPCommand
       if error != nil { completion?(false, Error.InvalidID.error(userInfo: [NSUnderlyingErrorKey: error!])) }
       else if let irCommand = command as? ITachIRCommand {
         if simulateCommandSuccess { simulateSuccess() }
-        else { ITachConnectionManager.sendCommand(irCommand, completion: completion) }
+        else { ITachConnectionManager.sendCommand(irCommand, priority: priority, completion: completion) }
       } else if let httpCommand = command as? HTTPCommand {
         if httpCommand.url.absoluteString!.isEmpty {
           MSLogError("cannot send command with an empty url")
           completion?(false, Error.CommandEmpty.error())
         }
         else if simulateCommandSuccess { simulateSuccess() }
+        else if ISYConnectionManager.connectionForHost(httpCommand.url.host) != nil {
+          ISYConnectionManager.sendCommand(httpCommand, completion: completion)
+        }
         else {
           let request = NSURLRequest(URL: httpCommand.url)
           NSURLConnection.sendAsynchronousRequest(request, queue: NSOperationQueue.mainQueue()) {
@@ -171,6 +236,127 @@ import class DataModel.HTTPCommand
     }
   }
 
+  /**
+  Streams the IR command while its button is held, `endStreamingCommandWithID:` must be invoked upon release. Commands
+  other than `ITachIRCommand` are simply sent.
+
+  :param: commandID NSManagedObjectID ID of the command to stream
+  :param: completion Callback? = nil Block to be executed once the stream has ended
+  */
+  public static func beginStreamingCommandWithID(commandID: NSManagedObjectID, completion: Callback? = nil) {
+    if simulateCommandSuccess || commandID.entity.name != "ITachIRCommand" {
+      sendCommandWithID(commandID, completion: completion)
+    } else if !wifiAvailable {
+      MSLogWarn("wifi not available")
+      completion?(false, Error.NoWifi.error())
+    } else {
+      var error: NSError?
+      let command = DataManager.rootContext.existingObjectWithID(commandID, error: &error) as? ITachIRCommand
+      if error != nil { completion?(false, Error.InvalidID.error(userInfo: [NSUnderlyingErrorKey: error!])) }
+      else if command != nil { ITachConnectionManager.beginStreamingCommand(command!, completion: completion) }
+    }
+  }
+
+  /**
+  Ends a stream started with `beginStreamingCommandWithID:completion:`
+
+  :param: commandID NSManagedObjectID
+  */
+  public static func endStreamingCommandWithID(commandID: NSManagedObjectID) {
+    if simulateCommandSuccess { return }
+    if let command = DataManager.rootContext.existingObjectWithID(commandID, error: nil) as? ITachIRCommand {
+      ITachConnectionManager.endStreamingCommand(command)
+    }
+  }
+
+  // MARK: - Pre-warming connections
+
+  /**
+  Opens connections ahead of time to the iTach and ISY devices referenced by the activity's launch macro and by the
+  commands reachable from the remote's buttons and command containers, so the first press does not wait on a connect.
+  Activity commands found on the remote contribute the devices used by the launch macro of their activity.
+
+  :param: activity Activity?
+  :param: remote Remote? = nil Defaults to the activity's remote
+  */
+  public static func prewarmConnectionsForActivity(activity: Activity?, remote: Remote? = nil) {
+    if simulateCommandSuccess || !wifiAvailable { return }
+
+    var commands: [Command] = []
+    if let macro = activity?.launchMacro { commands.append(macro) }
+    if let remote = remote ?? activity?.remote { commands.extend(commandsForElement(remote)) }
+    if commands.isEmpty { return }
+
+    let (iTachDevices, hosts) = devicesReferencedByCommands(commands)
+    MSLogDebug("pre-warming \(iTachDevices.count) iTach device(s) and \(hosts.count) http host(s)")
+    ITachConnectionManager.prewarmConnectionsForDevices(iTachDevices)
+    if let context = commands.first?.managedObjectContext where hosts.count > 0 {
+      let isyDevices = (ISYDevice.objectsInContext(context) as? [ISYDevice] ?? []).filter {
+        if let host = NSURL(string: $0.baseURL)?.host { return hosts ∋ host } else { return false }
+      }
+      ISYConnectionManager.prewarmConnectionsForDevices(isyDevices)
+    }
+  }
+
+  /**
+  Gathers the commands held by the element and its subelements for every mode
+
+  :param: element RemoteElement
+
+  :returns: [Command]
+  */
+  private static func commandsForElement(element: RemoteElement) -> [Command] {
+    var commands: [Command] = []
+    for mode in element.modes ∪ [element.defaultMode] {
+      if let button = element as? Button {
+        if let command = button.commandForMode(mode) { commands.append(command) }
+        if let command = button.longPressCommandForMode(mode) { commands.append(command) }
+      } else if let buttonGroup = element as? ButtonGroup, container = buttonGroup.commandContainerForMode(mode) {
+        var commandSets: [CommandSet] = []
+        if let commandSet = container as? CommandSet { commandSets.append(commandSet) }
+        else if let collection = container as? CommandSetCollection { commandSets.extend(collection.commandSets) }
+        for commandSet in commandSets { commands.extend(commandSet.commands?.allObjects as? [Command] ?? []) }
+      }
+    }
+    for subelement in element.subelements { commands.extend(commandsForElement(subelement)) }
+    return commands
+  }
+
+  /**
+  Follows macros, power commands and activity launch macros to the devices that would receive messages
+
+  :param: commands [Command]
+
+  :returns: ([ITachDevice], Set<String>) The iTach devices and the hosts addressed by http commands
+  */
+  private static func devicesReferencedByCommands(commands: [Command]) -> ([ITachDevice], Set<String>) {
+    var iTachDevices: [NSManagedObjectID:ITachDevice] = [:]
+    var hosts: Set<String> = []
+    var visited: Set<NSManagedObjectID> = []
+    var pending = commands
+    while !pending.isEmpty {
+      let command = pending.removeLast()
+      if visited ∋ command.objectID { continue }
+      visited.insert(command.objectID)
+      switch command {
+        case let irCommand as ITachIRCommand where irCommand.code != nil:
+          if let device = irCommand.networkDevice as? ITachDevice { iTachDevices[device.objectID] = device }
+        case let httpCommand as HTTPCommand:
+          if let host = httpCommand.url.host { hosts.insert(host) }
+        case let macroCommand as MacroCommand:
+          pending.extend(macroCommand.commands)
+        case let powerCommand as PowerCommand:
+          if let command = powerCommand.device.onCommand { pending.append(command) }
+          if let command = powerCommand.device.offCommand { pending.append(command) }
+        case let activityCommand as ActivityCommand:
+          if let macro = activityCommand.activity?.launchMacro { pending.append(macro) }
+        default:
+          break
+      }
+    }
+    return (Array(iTachDevices.values), hosts)
+  }
+
   // MARK: - Network device discovery
 
   public typealias DiscoveryCallback = (NetworkDevice) -> Void
@@ -24,7 +24,18 @@ import class DataModel.DataManager
   static private(set) var networkDevices = Set(ISYDevice.objectsInContext(DataManager.rootContext) as! [ISYDevice])
 
   /** Currently connected devices. */
-  static var connections = Set<ISYDeviceConnection>()
+  static var connections: Set<ISYDeviceConnection> {
+    var connections = Set<ISYDeviceConnection>()
+    dispatch_sync(connectionsQueue) { connections = self.deviceConnections }
+    return connections
+  }
+
+  /** Backs `connections`, only accessed on `connectionsQueue` */
+  static private var deviceConnections = Set<ISYDeviceConnection>()
+
+  /** Serializes access to the connections, which are looked up from the main queue, multicast and the root context */
+  static private let connectionsQueue = dispatch_queue_create("com.moondeerstudios.networking.isy.connections",
+                                                              DISPATCH_QUEUE_SERIAL)
 
   /** Uuids  from processed beacons. */
   static private var beaconsReceived = Set<String>()
@@ -51,47 +62,108 @@ import class DataModel.DataManager
   class func stopDetectingNetworkDevices() { detectingNetworkDevices = false; multicastConnection.stopListening() }
 
   /**
-  Sends an IR command to the device identified by the specified `uuid`.
+  connectionForHost:
+
+  :param: host String?
+
+  :returns: ISYDeviceConnection?
+  */
+  class func connectionForHost(host: String?) -> ISYDeviceConnection? {
+    return host == nil ? nil : findFirst(connections, {$0.baseURL.host == host})
+  }
+
+  /**
+  The connection for `device`, created and added to `connections` when there is none yet. Each device has a single
+  connection whichever context its object comes from, a second one would duplicate the first's node updates and event
+  subscription. Must be invoked on the queue of the device's context.
+
+  :param: device ISYDevice
+
+  :returns: ISYDeviceConnection
+  */
+  class func connectionForDevice(device: ISYDevice) -> ISYDeviceConnection {
+    let uniqueIdentifier = device.uniqueIdentifier
+    var connection: ISYDeviceConnection?
+    dispatch_sync(connectionsQueue) {
+      connection = findFirst(self.deviceConnections, {$0.uniqueIdentifier == uniqueIdentifier})
+      if connection == nil {
+        connection = ISYDeviceConnection(device: device)
+        self.deviceConnections.insert(connection!)
+      }
+    }
+    return connection!
+  }
+
+  /**
+  Adds the root context's object for the connection's device to `networkDevices`
+
+  :param: connection ISYDeviceConnection
+  */
+  private class func insertNetworkDeviceForConnection(connection: ISYDeviceConnection) {
+    let moc = DataManager.rootContext
+    moc.performBlock {
+      if let device = moc.existingObjectWithID(connection.deviceID, error: nil) as? ISYDevice {
+        ISYConnectionManager.networkDevices.insert(device)
+      }
+    }
+  }
+
+  /**
+  Sends an HTTP command over the session of the connection for the command's host
 
   :param: command HTTPCommand The command to execute
   :param: completion Callback? = nil The block to execute upon task completion
   */
   class func sendCommand(command: HTTPCommand, completion: Callback? = nil) {
-    // ???: Not used because `ConnectionManager` sends the `HTTPCommand`?
+    if let connection = connectionForHost(command.url.host) {
+      connection.sendRequest(NSURLRequest(URL: command.url)) { completion?($1 == nil, $1) }
+    } else { completion?(false, Error.InvalidNetworkDevice.error()) }
+  }
+
+  /**
+  Creates connections for the specified devices as needed and has each open its HTTP connection ahead of time
+
+  :param: devices [ISYDevice]
+  */
+  class func prewarmConnectionsForDevices(devices: [ISYDevice]) {
+    apply(devices) { ISYConnectionManager.connectionForDevice($0).prewarm() }
   }
 
   /** Suspend active connections */
-  class func suspend() { if detectingNetworkDevices { multicastConnection.stopListening() } }
+  class func suspend() {
+    if detectingNetworkDevices { multicastConnection.stopListening() }
+    apply(connections) { $0.unsubscribeFromEvents() }
+  }
 
   /** Resume previously active connections */
-  class func resume() { if detectingNetworkDevices { multicastConnection.listen() } }
+  class func resume() {
+    if detectingNetworkDevices { multicastConnection.listen() }
+    apply(connections) { $0.subscribeToEvents() }
+  }
 
   /**
-  Processes messages received through `NetworkDeviceConnection` objects.
+  Processes beacons received through the multicast connection.
 
-  :param: message String Contents of the message received by the device connection
+  :param: beacon Beacon The beacon received by the multicast connection
   */
-  class func messageReceived(message: String) {
-
-    MSLogVerbose("message received over multicast connection:\n\(message.stringByAddingPercentEscapesUsingEncoding(NSUTF8StringEncoding))\n")
+  class func messageReceived(beacon: Beacon) {
 
-    let entryStrings = message.matchingSubstringsForRegEx("^[A-Z]+:.*(?=\\r)") as! [String]
-    MSLogVerbose("entryStrings = \(entryStrings)")
-
-    var entries: [String:String] = [:]
-    apply(entryStrings) {
-      let components = ":".split($0)
-      if components.count == 2 { entries[components[0]] = components[1] }
-    }
-
-    if let location = entries["LOCATION"] where location.hasSuffix("/desc") && beaconsReceived ∌ location,
+    if let location = beacon.location where location.hasSuffix("/desc") && beaconsReceived ∌ location,
       let baseURL = NSURL(string: location[0..<location.length - 5])
     {
+      MSLogVerbose("beacon received over multicast connection from '\(location)'")
       beaconsReceived.insert(location)
+
+      // A device whose connection was created ahead of time keeps that connection
+      if let connection = connectionForHost(baseURL.host) {
+        insertNetworkDeviceForConnection(connection)
+        stopDetectingNetworkDevices()
+        return
+      }
+
       ISYDeviceConnection.connectionWithBaseURL(baseURL) {
         if let connection = $0 {
-          ISYConnectionManager.connections.insert(connection)
-          self.networkDevices.insert(connection.device)
+          ISYConnectionManager.insertNetworkDeviceForConnection(connection)
           ISYConnectionManager.stopDetectingNetworkDevices()
         } else { MSHandleError($1) }
       }
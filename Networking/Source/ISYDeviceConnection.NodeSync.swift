@@ -0,0 +1,157 @@
+//
+//  ISYDeviceConnection.NodeSync.swift
+//  Remote
+//
+//  Created by Jason Cardwell on 5/22/15.
+//  Copyright (c) 2015 Moondeer Studios. All rights reserved.
+//
+
+import Foundation
+import CoreData
+import MoonKit
+import class DataModel.ISYDevice
+import class DataModel.ISYDeviceNode
+import class DataModel.ISYDeviceGroup
+
+extension ISYDeviceConnection {
+
+  /** The attributes of a `<node>` element from `rest/nodes` */
+  struct NodeRecord {
+    var address = ""
+    var name = ""
+    var type = ""
+    var pnode = ""
+    var flag: Int16 = 0
+    var enabled = false
+    var propertyID = ""
+    var propertyValue: Int16 = 0
+    var propertyUOM = ""
+    var propertyFormatted = ""
+  }
+
+  /** The attributes of a `<group>` element from `rest/nodes`, `members` holds node addresses */
+  struct GroupRecord {
+    var address = ""
+    var name = ""
+    var flag: Int16 = 0
+    var family: Int16 = 0
+    var members: [String] = []
+  }
+
+  /**
+  Reconciles the device's nodes and groups with those reported by the ISY. Existing objects are fetched once and matched
+  by address, only attributes that differ are written, objects the ISY no longer reports are deleted and the context is
+  saved once, and only when something changed. Where earlier imports left several objects with the same address all
+  but one are deleted.
+
+  :param: nodes [NodeRecord]
+  :param: groups [GroupRecord]
+  :param: device ISYDevice Must belong to `context`
+  :param: context NSManagedObjectContext
+
+  :returns: Bool Whether the context saved without error
+  */
+  static func synchronizeNodes(nodes: [NodeRecord],
+                        groups: [GroupRecord],
+                     forDevice device: ISYDevice,
+                       context: NSManagedObjectContext) -> Bool
+  {
+    var existingNodes = objectsByAddress(existingObjectsOfEntity("ISYDeviceNode", forDevice: device, context: context)
+                                           as! [ISYDeviceNode], address: {$0.address}, context: context)
+    var existingGroups = objectsByAddress(existingObjectsOfEntity("ISYDeviceGroup", forDevice: device, context: context)
+                                            as! [ISYDeviceGroup], address: {$0.address}, context: context)
+
+    var nodesByAddress: [String:ISYDeviceNode] = [:]
+    for record in nodes {
+      let node: ISYDeviceNode
+      if let existing = existingNodes.removeValueForKey(record.address) { node = existing }
+      else { node = ISYDeviceNode(context: context); node.address = record.address; node.device = device }
+      updateNode(node, withRecord: record)
+      nodesByAddress[record.address] = node
+    }
+
+    for record in groups {
+      let group: ISYDeviceGroup
+      if let existing = existingGroups.removeValueForKey(record.address) { group = existing }
+      else { group = ISYDeviceGroup(context: context); group.address = record.address; group.device = device }
+      if group.name != record.name { group.name = record.name }
+      if group.flag != record.flag { group.flag = record.flag }
+      if group.family != record.family { group.family = record.family }
+      let members = Set(compressedMap(record.members, {nodesByAddress[$0]}))
+      if group.members != members { group.members = members }
+    }
+
+    apply(existingNodes.values) { context.deleteObject($0) }
+    apply(existingGroups.values) { context.deleteObject($0) }
+
+    if !context.hasChanges { return true }
+    MSLogDebug("inserted \(context.insertedObjects.count), updated \(context.updatedObjects.count), deleted "
+             + "\(context.deletedObjects.count) objects synchronizing nodes for '\(device.baseURL)'")
+    var error: NSError?
+    let saved = context.save(&error)
+    MSHandleError(error, message: "failed to save synchronized nodes")
+    return saved
+  }
+
+  /**
+  Writes the attributes of `record` that differ from those of `node`
+
+  :param: node ISYDeviceNode
+  :param: record NodeRecord
+  */
+  private static func updateNode(node: ISYDeviceNode, withRecord record: NodeRecord) {
+    if node.name != record.name { node.name = record.name }
+    if node.type != record.type { node.type = record.type }
+    if node.pnode != record.pnode { node.pnode = record.pnode }
+    if node.flag != record.flag { node.flag = record.flag }
+    if node.enabled != record.enabled { node.enabled = record.enabled }
+    if node.propertyID != record.propertyID { node.propertyID = record.propertyID }
+    if node.propertyValue != record.propertyValue { node.propertyValue = record.propertyValue }
+    if node.propertyUOM != record.propertyUOM { node.propertyUOM = record.propertyUOM }
+    if node.propertyFormatted != record.propertyFormatted { node.propertyFormatted = record.propertyFormatted }
+  }
+
+  /**
+  Fetches every object of the entity belonging to `device` in a single request
+
+  :param: entityName String
+  :param: device ISYDevice
+  :param: context NSManagedObjectContext
+
+  :returns: [AnyObject]
+  */
+  private static func existingObjectsOfEntity(entityName: String,
+                                    forDevice device: ISYDevice,
+                                      context: NSManagedObjectContext) -> [AnyObject]
+  {
+    let request = NSFetchRequest(entityName: entityName)
+    request.predicate = NSPredicate(format: "device == %@", device)
+    request.returnsObjectsAsFaults = false
+    var error: NSError?
+    let result = context.executeFetchRequest(request, error: &error)
+    MSHandleError(error, message: "failed to fetch existing '\(entityName)' objects")
+    return result ?? []
+  }
+
+  /**
+  Keys the objects by address, the first object for an address is kept and any others are deleted from `context`
+
+  :param: objects [T]
+  :param: address (T) -> String
+  :param: context NSManagedObjectContext
+
+  :returns: [String:T]
+  */
+  private static func objectsByAddress<T:NSManagedObject>(objects: [T],
+                                                   address: (T) -> String,
+                                                   context: NSManagedObjectContext) -> [String:T]
+  {
+    var result: [String:T] = [:]
+    for object in objects {
+      let key = address(object)
+      if result[key] == nil { result[key] = object } else { context.deleteObject(object) }
+    }
+    return result
+  }
+
+}
@@ -0,0 +1,149 @@
+//
+//  ISYDeviceConnection.NodesDecoder.swift
+//  Remote
+//
+//  Created by Jason Cardwell on 5/22/15.
+//  Copyright (c) 2015 Moondeer Studios. All rights reserved.
+//
+
+import Foundation
+import MoonKit
+
+extension ISYDeviceConnection {
+
+  /**
+  Decodes a `rest/nodes` reply into node and group records in a single pass over the parser's events. Each record is
+  filled in as its elements close, no intermediate tree is built and no element outside a `<node>` or `<group>` is kept.
+  */
+  @objc final class NodesDecoder: NSObject, NSXMLParserDelegate {
+
+    private(set) var nodes: [NodeRecord] = []
+    private(set) var groups: [GroupRecord] = []
+
+    private var node: NodeRecord?
+    private var group: GroupRecord?
+    private var text = ""
+
+    /**
+    Decodes `data`, returning `nil` if it is not well formed
+
+    :param: data NSData
+
+    :returns: ([NodeRecord], [GroupRecord])?
+    */
+    static func decode(data: NSData) -> ([NodeRecord], [GroupRecord])? {
+      let decoder = NodesDecoder()
+      let parser = NSXMLParser(data: data)
+      parser.delegate = decoder
+      if parser.parse() { return (decoder.nodes, decoder.groups) }
+      MSHandleError(parser.parserError, message: "failed to decode nodes")
+      return nil
+    }
+
+    /**
+    Integer value of `string`, clamped to the range of `Int16` so that an out of range value cannot trap
+
+    :param: string String?
+
+    :returns: Int16
+    */
+    private static func int16FromString(string: String?) -> Int16 {
+      return Int16(max(Int(Int16.min), min(Int(Int16.max), string?.toInt() ?? 0)))
+    }
+
+    /**
+    Integer value of the attribute named `key`
+
+    :param: key String
+    :param: attributes [NSObject:AnyObject]
+
+    :returns: Int16
+    */
+    private static func int16ForKey(key: String, inAttributes attributes: [NSObject:AnyObject]) -> Int16 {
+      return int16FromString(attributes[key] as? String)
+    }
+
+    /**
+    parser:didStartElement:namespaceURI:qualifiedName:attributes:
+
+    :param: parser NSXMLParser
+    :param: elementName String
+    :param: namespaceURI String!
+    :param: qName String!
+    :param: attributeDict [NSObject:AnyObject]!
+    */
+    func parser(parser: NSXMLParser,
+      didStartElement elementName: String,
+      namespaceURI: String!,
+      qualifiedName qName: String!,
+      attributes attributeDict: [NSObject:AnyObject]!)
+    {
+      text = ""
+      let attributes = attributeDict ?? [:]
+      switch elementName {
+        case "node":
+          node = NodeRecord()
+          node?.flag = NodesDecoder.int16ForKey("flag", inAttributes: attributes)
+        case "group":
+          group = GroupRecord()
+          group?.flag = NodesDecoder.int16ForKey("flag", inAttributes: attributes)
+        case "property" where node != nil:
+          node?.propertyID = attributes["id"] as? String ?? ""
+          node?.propertyValue = NodesDecoder.int16ForKey("value", inAttributes: attributes)
+          node?.propertyUOM = attributes["uom"] as? String ?? ""
+          node?.propertyFormatted = attributes["formatted"] as? String ?? ""
+        default:
+          break
+      }
+    }
+
+    /**
+    parser:foundCharacters:
+
+    :param: parser NSXMLParser
+    :param: string String!
+    */
+    func parser(parser: NSXMLParser, foundCharacters string: String!) {
+      if (node != nil || group != nil) && string != nil { text += string }
+    }
+
+    /**
+    parser:didEndElement:namespaceURI:qualifiedName:
+
+    :param: parser NSXMLParser
+    :param: elementName String
+    :param: namespaceURI String!
+    :param: qName String!
+    */
+    func parser(parser: NSXMLParser,
+      didEndElement elementName: String,
+      namespaceURI: String!,
+      qualifiedName qName: String!)
+    {
+      let value = text.stringByTrimmingCharactersInSet(NSCharacterSet.whitespaceAndNewlineCharacterSet())
+      text = ""
+      if node != nil {
+        switch elementName {
+          case "address": node?.address = value
+          case "name":    node?.name = value
+          case "type":    node?.type = value
+          case "pnode":   node?.pnode = value
+          case "enabled": node?.enabled = value == "true"
+          case "node":    nodes.append(node!); node = nil
+          default:        break
+        }
+      } else if group != nil {
+        switch elementName {
+          case "address": group?.address = value
+          case "name":    group?.name = value
+          case "family":  group?.family = NodesDecoder.int16FromString(value)
+          case "link":    group?.members.append(value)
+          case "group":   groups.append(group!); group = nil
+          default:        break
+        }
+      }
+    }
+
+  }
+
+}
@@ -7,6 +7,7 @@
 //
 
 import Foundation
+import CoreData
 import MoonKit
 import class DataModel.ISYDevice
 import class DataModel.ISYDeviceNode
@@ -17,6 +18,22 @@ import class DataModel.DataManager
 
 final class ISYDeviceConnection: Equatable, Hashable {
 
+  typealias Callback = ConnectionManager.Callback
+  typealias Error = ConnectionManager.Error
+  typealias RequestCompletion = (NSData?, NSError?) -> Void
+
+  private static let User = "moondeer"
+  private static let Password = "1bluebear"
+
+  /** Number of requests the session may have outstanding before further requests wait their turn */
+  static let MaxRequestsInFlight = 4
+
+  /** Number of requests that may wait for their turn before further requests are refused */
+  static let MaxRequestsWaiting = 64
+
+  /** Units of measure whose values are on levels from 0 to 255 */
+  private static let OnLevelUnits: Set<String> = ["%/on/off", "on/off"]
+
   /** A class to stand in as delegate for `NSURLConnection` requests */
   @objc private class ConnectionDelegate: NSObject, NSURLConnectionDelegate, NSURLConnectionDataDelegate {
 
@@ -69,18 +86,198 @@ final class ISYDeviceConnection: Equatable, Hashable {
   /** Use by class method `connectionWithBaseURL` to keep connection from being deallocated */
   private static var URLConnection: NSURLConnection?
 
-  /** Use by instances to keep connection from being deallocated */
-  private var urlConnection: NSURLConnection?
+  /** Answers the device's authentication challenges with the connection's credentials */
+  @objc private class SessionDelegate: NSObject, NSURLSessionTaskDelegate {
+
+    /**
+    URLSession:task:didReceiveChallenge:completionHandler:
+
+    :param: session NSURLSession
+    :param: task NSURLSessionTask
+    :param: challenge NSURLAuthenticationChallenge
+    :param: completionHandler (NSURLSessionAuthChallengeDisposition, NSURLCredential!) -> Void
+    */
+    func URLSession(session: NSURLSession,
+               task: NSURLSessionTask,
+     didReceiveChallenge challenge: NSURLAuthenticationChallenge,
+      completionHandler: (NSURLSessionAuthChallengeDisposition, NSURLCredential!) -> Void)
+    {
+      if challenge.previousFailureCount == 0 {
+        let credential = NSURLCredential(user: ISYDeviceConnection.User,
+                                         password: ISYDeviceConnection.Password,
+                                         persistence: .ForSession)
+        completionHandler(.UseCredential, credential)
+      } else { completionHandler(.PerformDefaultHandling, nil) }
+    }
+
+  }
+
+  /** A request waiting for one of the session's in-flight slots */
+  private struct PendingRequest {
+    let request: NSURLRequest
+    let completion: RequestCompletion?
+  }
+
+  /** Serializes the request bookkeeping, the session delivers its callbacks here as well */
+  private let sessionQueue: NSOperationQueue = {
+    let queue = NSOperationQueue()
+    queue.name = "com.moondeerstudios.networking.isy"
+    queue.maxConcurrentOperationCount = 1
+    return queue
+  }()
+
+  /**
+  Session reused by every request to the device, connections are kept alive and requests pipelined. Credentials are
+  supplied by `SessionDelegate` when the device challenges a request.
+  */
+  private lazy var session: NSURLSession = {
+    let configuration = NSURLSessionConfiguration.defaultSessionConfiguration()
+    configuration.HTTPShouldUsePipelining = true
+    configuration.HTTPMaximumConnectionsPerHost = ISYDeviceConnection.MaxRequestsInFlight
+    configuration.requestCachePolicy = .ReloadIgnoringLocalCacheData
+    configuration.URLCache = nil
+    return NSURLSession(configuration: configuration, delegate: SessionDelegate(), delegateQueue: self.sessionQueue)
+  }()
+
+  private var requestsInFlight = 0
+  private var waitingRequests = Queue<PendingRequest>()
+
+  /** Identifies the device in any context, the connection keeps no managed object of its own */
+  let deviceID: NSManagedObjectID
+
+  /** The device's UDN, which identifies the connection */
+  let uniqueIdentifier: String
 
-  let device: ISYDevice
-  var baseURL: NSURL! { return NSURL(string: device.baseURL)! }
+  let baseURL: NSURL
 
   /**
-  init:
+  Copies what the connection needs from `device`, must be invoked on the queue of the device's context
 
   :param: d ISYDevice
   */
-  init(device d: ISYDevice) { device = d; updateNodes() }
+  init(device d: ISYDevice) {
+    deviceID = d.objectID
+    uniqueIdentifier = d.uniqueIdentifier
+    baseURL = NSURL(string: d.baseURL)!
+    updateNodes()
+    eventStream.eventHandler = {[weak self] in self?.applyEvent($0); return}
+    eventStream.subscribe()
+  }
+
+  /** Outstanding tasks are cancelled, their completions still run but no longer reach the connection */
+  deinit { eventStream.unsubscribe(); session.invalidateAndCancel() }
+
+  // MARK: - Events
+
+  /** Pushes node property changes as they happen, so node state is kept without polling `rest/nodes` */
+  private lazy var eventStream: ISYEventStream = ISYEventStream(baseURL: self.baseURL,
+                                                                user: ISYDeviceConnection.User,
+                                                                password: ISYDeviceConnection.Password)
+
+  /** Resumes the event subscription */
+  func subscribeToEvents() { eventStream.subscribe() }
+
+  /** Suspends the event subscription */
+  func unsubscribeFromEvents() { eventStream.unsubscribe() }
+
+  /**
+  Formatted text the ISY shows for an on level
+
+  :param: value Int
+
+  :returns: String
+  */
+  private static func formattedValue(value: Int) -> String {
+    switch value {
+      case 0: return "Off"
+      case 255: return "On"
+      default: return "\(Int(round(Double(value) / 2.55)))%"
+    }
+  }
+
+  /**
+  Applies a property event to the node it reports on, only events for the property the node models are applied. Values
+  outside the range of the node's property are ignored and only on levels are formatted as the ISY shows them.
+
+  :param: event ISYEventStream.Event
+  */
+  private func applyEvent(event: ISYEventStream.Event) {
+    if !event.isNodeEvent { return }
+    if let value = event.action.toInt() {
+      if value < Int(Int16.min) || value > Int(Int16.max) {
+        MSLogWarn("ignoring out of range value '\(value)' for node '\(event.node)'")
+        return
+      }
+      let moc = DataManager.rootContext
+      let deviceID = self.deviceID
+      moc.performBlock {
+        let request = NSFetchRequest(entityName: "ISYDeviceNode")
+        request.predicate = NSPredicate(format: "device == %@ AND address == %@ AND propertyID == %@",
+                                        deviceID, event.node, event.control)
+        request.fetchLimit = 1
+        var error: NSError?
+        let result = moc.executeFetchRequest(request, error: &error)
+        MSHandleError(error, message: "failed to fetch node '\(event.node)'")
+        if let node = result?.first as? ISYDeviceNode where Int(node.propertyValue) != value {
+          node.propertyValue = Int16(value)
+          node.propertyFormatted = ISYDeviceConnection.OnLevelUnits ∋ node.propertyUOM
+                                     ? ISYDeviceConnection.formattedValue(value)
+                                     : "\(value)"
+          moc.save(&error)
+          MSHandleError(error, message: "failed to save update for node '\(event.node)'")
+        }
+      }
+    }
+  }
+
+  /**
+  Sends the request over the device's session once an in-flight slot is free
+
+  :param: request NSURLRequest
+  :param: completion RequestCompletion? = nil Receives the response body, or an error for a failed request or a status
+  outside the 2xx range
+  */
+  func sendRequest(request: NSURLRequest, completion: RequestCompletion? = nil) {
+    sessionQueue.addOperationWithBlock {
+      [weak self] in
+
+      if let connection = self {
+        let pending = PendingRequest(request: request, completion: completion)
+        if connection.requestsInFlight < ISYDeviceConnection.MaxRequestsInFlight { connection.resumeRequest(pending) }
+        else if connection.waitingRequests.count < ISYDeviceConnection.MaxRequestsWaiting {
+          connection.waitingRequests.enqueue(pending)
+        } else {
+          MSLogWarn("too many requests waiting for '\(connection.baseURL)', refusing request for '\(request.URL)'")
+          completion?(nil, Error.QueueFull.error())
+        }
+      } else { completion?(nil, Error.CommandHalted.error()) }
+    }
+  }
+
+  /**
+  Starts a task for the request, the next waiting request follows as soon as the task completes
+
+  :param: pending PendingRequest
+  */
+  private func resumeRequest(pending: PendingRequest) {
+    requestsInFlight++
+    let task = session.dataTaskWithRequest(pending.request) {
+      [weak self] (data: NSData!, response: NSURLResponse!, error: NSError!) -> Void in
+
+      if let connection = self {
+        connection.requestsInFlight--
+        if let next = connection.waitingRequests.dequeue() { connection.resumeRequest(next) }
+      }
+
+      if let status = (response as? NSHTTPURLResponse)?.statusCode where error == nil && !(200 ..< 300 ~= status) {
+        let description = NSHTTPURLResponse.localizedStringForStatusCode(status)
+        pending.completion?(nil, Error.NetworkDeviceError.error(userInfo: [NSLocalizedDescriptionKey: description]))
+      } else {
+        pending.completion?(error == nil ? data : nil, error)
+      }
+    }
+    task.resume()
+  }
 
   /**
   connectionWithBaseURL:
@@ -105,8 +302,8 @@ final class ISYDeviceConnection: Equatable, Hashable {
       }
 
       let delegate = ConnectionDelegate()
-      delegate.user = "moondeer"
-      delegate.password = "1bluebear"
+      delegate.user = ISYDeviceConnection.User
+      delegate.password = ISYDeviceConnection.Password
       delegate.didFail = { completion(nil, $0) }
 
       delegate.didReceiveData = {
@@ -140,7 +337,7 @@ final class ISYDeviceConnection: Equatable, Hashable {
                 device.setValuesForKeysWithDictionary(attributes as [NSObject : AnyObject])
                 var error: NSError?
                 let saved = moc.save(&error)
-                if saved { completionWrapper(ISYDeviceConnection(device: device), error) }
+                if saved { completionWrapper(ISYConnectionManager.connectionForDevice(device), error) }
                 else { completionWrapper(nil, error) }
               }
           } else { completionWrapper(nil, nil) }
@@ -157,76 +354,31 @@ final class ISYDeviceConnection: Equatable, Hashable {
   private func updateNodes() {
 
     if let url = NSURL(string: "rest/nodes", relativeToURL: baseURL) {
-      let request = NSURLRequest(URL: url)
-      let delegate = ConnectionDelegate()
-      delegate.user = "moondeer"
-      delegate.password = "1bluebear"
-      delegate.didReceiveData = { [unowned self] in
-        let parsedData = MSDictionary(byParsingXML: $0)
-        let moc = DataManager.rootContext
-
-        moc.performBlock { [unowned self] in
-
-          let nodes = findFirstValueForKeyInContainer("node", parsedData) as! [MSDictionary]
-
-          let nodeKeys = ["flag", "address", "type", "enabled", "pnode", "name"]
-          let nodeModels = MSDictionary()
-
-          for node in nodes {
-
-            let propertyID        = node["property"]!["id"] as! String
-            let propertyValue     = node["property"]!["value"] as! String
-            let propertyUOM       = node["property"]!["uom"] as! String
-            let propertyFormatted = node["property"]!["formatted"] as! String
-
-            node.filter {key, _ in contains(nodeKeys, key as! String)}
-
-            node["propertyID"]        = propertyID
-            node["propertyValue"]     = propertyValue.toInt()
-            node["propertyUOM"]       = propertyUOM
-            node["propertyFormatted"] = propertyFormatted
-            node["device"]            = self.device
-            node["enabled"]           = (node["enabled"] as! String) == "true"
-            node["flag"]              = (node["flag"] as! String).toInt()
-
-            let nodeModel = ISYDeviceNode(context: moc)
-            nodeModel.setValuesForKeysWithDictionary(node as [NSObject:AnyObject])
-
-            nodeModels[nodeModel.address] = nodeModel
-
-          }
-
-          var error: NSError?
-          var saved = moc.save(&error)
-          assert(!MSHandleError(error))
-
-          let groups = findFirstValueForKeyInContainer("group", parsedData) as! [MSDictionary]
-          let groupKeys = ["flag", "address", "name", "family", "members"]
-
-          for group in groups {
-
-            group.filter {key, _ in  contains(groupKeys, key as! String) }
-            if let members = group["members"]?["link"] as? [MSDictionary] {
-              group["members"] = Set((members as NSArray).mapped {member, _ in nodeModels[member["link"]] } as! [String])
+      sendRequest(NSURLRequest(URL: url)) {
+        [weak self] data, error in
+
+        if data == nil { MSHandleError(error); return }
+        if let deviceID = self?.deviceID, decoded = NodesDecoder.decode(data!) {
+          let moc = DataManager.rootContext
+          moc.performBlock {
+            if let device = moc.existingObjectWithID(deviceID, error: nil) as? ISYDevice {
+              ISYDeviceConnection.synchronizeNodes(decoded.0, groups: decoded.1, forDevice: device, context: moc)
             }
-
-            group["device"] = self.device
-            group["flag"] = (group["flag"] as? String)?.toInt()
-            group["family"] = (group["family"] as? String)?.toInt()
-
-            let groupModel = ISYDeviceGroup(context: moc)
-            groupModel.setValuesForKeysWithDictionary(group as [NSObject:AnyObject])
-
           }
-
-          saved = moc.save(&error)
-          assert(!MSHandleError(error))
-
         }
-
       }
+    }
+  }
 
-      urlConnection = NSURLConnection(request: request, delegate: delegate)
+  /**
+  Issues a `HEAD` request for the device description so the host is resolved and a keep-alive connection is open
+  before the first command is sent
+  */
+  func prewarm() {
+    if let url = NSURL(string: "desc", relativeToURL: baseURL) {
+      let request = NSMutableURLRequest(URL: url)
+      request.HTTPMethod = "HEAD"
+      sendRequest(request)
     }
   }
 
@@ -236,22 +388,16 @@ final class ISYDeviceConnection: Equatable, Hashable {
   :param: command String
   :param: nodeID String
   :param: parameters [String]
-  :param: completion ((Bool, NSError?) -> Void)? = nil
+  :param: completion Callback? = nil
   */
   func sendRestCommand(command: String,
                 toNode nodeID: String,
             parameters: [String],
-            completion: ((Bool, NSError?) -> Void)? = nil)
+            completion: Callback? = nil)
   {
     let text = "rest/nodes/\(nodeID)/cmd/\(command)" + (parameters.count > 0 ? "/" + "/".join(parameters) : "")
     if let url = NSURL(string: text, relativeToURL: baseURL) {
-      let request = NSURLRequest(URL: url)
-      let delegate = ConnectionDelegate()
-      delegate.user = "moondeer"
-      delegate.password = "1bluebear"
-      delegate.didFail = { completion?(false, $0) }
-      delegate.didReceiveData = {_ in completion?(true, nil) }
-      urlConnection = NSURLConnection(request: request, delegate: delegate)
+      sendRequest(NSURLRequest(URL: url)) { completion?($1 == nil, $1) }
     }
     else { completion?(false, nil) }
   }
@@ -260,9 +406,9 @@ final class ISYDeviceConnection: Equatable, Hashable {
   Send a Soap command over the connection with optional completion callback
 
   :param: body String The command's content, this must not be empty
-  :param: completion ((Bool, NSError?) -> Void)? = nil
+  :param: completion Callback? = nil
   */
-  func sendSoapCommandWithBody(body: String, completion: ((Bool, NSError?) -> Void)? = nil) {
+  func sendSoapCommandWithBody(body: String, completion: Callback? = nil) {
     assert(!body.isEmpty)
     if let url = NSURL(string: "services", relativeToURL: baseURL) {
 
@@ -273,19 +419,13 @@ final class ISYDeviceConnection: Equatable, Hashable {
         forHTTPHeaderField: "SOAPACTION")
       request.HTTPBody = body.dataUsingEncoding(NSUTF8StringEncoding)
 
-      let delegate = ConnectionDelegate()
-      delegate.user = "moondeer"
-      delegate.password = "1bluebear"
-      delegate.didFail = { completion?(false, $0) }
-      delegate.didReceiveData = { _ in completion?(true, nil) }
-
-      urlConnection = NSURLConnection(request: request, delegate: delegate)
+      sendRequest(request) { completion?($1 == nil, $1) }
 
     } else { completion?(false, nil) }
 
   }
 
-  var hashValue: Int { return baseURL.hashValue }
+  var hashValue: Int { return uniqueIdentifier.hashValue }
 }
 
 /**
@@ -297,5 +437,5 @@ Equatable support
 :returns: Bool
 */
 func ==(lhs: ISYDeviceConnection, rhs: ISYDeviceConnection) -> Bool {
-  return lhs === rhs || lhs.baseURL == rhs.baseURL
+  return lhs === rhs || lhs.uniqueIdentifier == rhs.uniqueIdentifier
 }
\ No newline at end of file
@@ -0,0 +1,228 @@
+//
+//  ISYEventStream.swift
+//  Remote
+//
+//  Created by Jason Cardwell on 5/21/15.
+//  Copyright (c) 2015 Moondeer Studios. All rights reserved.
+//
+
+import Foundation
+import MoonKit
+
+/**
+Subscription to the event stream of an ISY. The `Subscribe` request asks the ISY to reuse the socket it arrives on, so
+one long-lived connection carries every event the ISY reports afterwards. Events are scanned tag by tag as they are read
+and handed to `eventHandler` as each `</Event>` closes. A dropped connection is resubscribed after `RetryInterval`
+until `unsubscribe` is invoked.
+*/
+final class ISYEventStream: NetworkDeviceConnectionDelegate {
+
+  /** An event as reported by the ISY, `control` is `ST`, `OL`, etc. for node properties and `_<n>` for system events */
+  struct Event {
+    let control: String
+    let action: String
+    let node: String
+    let sequenceNumber: Int?
+
+    /** Whether the event reports a node property rather than a system event */
+    var isNodeEvent: Bool { return !node.isEmpty && !control.hasPrefix("_") }
+  }
+
+  /** Seconds to wait before resubscribing after the connection drops */
+  static let RetryInterval: NSTimeInterval = 5
+
+  /** Frames end with each tag so that every closing tag arrives along with the text it closes */
+  static let Delimiter = UInt8(ascii: ">")
+
+  let baseURL: NSURL
+  let user: String
+  let password: String
+
+  /** Invoked on the stream's queue for each event received */
+  var eventHandler: ((Event) -> Void)?
+
+  /** Subscription identifier returned by the ISY */
+  private(set) var subscriptionID: String?
+
+  /** Whether the stream should be subscribed, cleared by `unsubscribe` */
+  private(set) var subscribed = false
+
+  private let queue = dispatch_queue_create("com.moondeerstudios.networking.isy-events", DISPATCH_QUEUE_SERIAL)
+  private var socket: NetworkDeviceConnection!
+
+  // Fields of the event being scanned
+  private var inEvent = false
+  private var sequenceNumber: Int?
+  private var fields: [String:String] = [:]
+
+  /**
+  initWithBaseURL:user:password:
+
+  :param: baseURL NSURL
+  :param: user String
+  :param: password String
+  */
+  init(baseURL: NSURL, user: String, password: String) {
+    self.baseURL = baseURL
+    self.user = user
+    self.password = password
+    socket = NetworkDeviceConnection(delegateQueue: queue, delimiter: ISYEventStream.Delimiter)
+    socket.delegate = self
+  }
+
+  /** Opens the connection and subscribes, does nothing when already subscribed */
+  func subscribe() {
+    dispatch_async(queue) {
+      if self.subscribed { return }
+      self.subscribed = true
+      self.connect()
+    }
+  }
+
+  /** Closes the connection and stops resubscribing */
+  func unsubscribe() {
+    dispatch_async(queue) {
+      self.subscribed = false
+      self.subscriptionID = nil
+      self.socket.disconnect()
+    }
+  }
+
+  /** Connects to the host of `baseURL` */
+  private func connect() {
+    if let host = baseURL.host {
+      let port = UInt16(baseURL.port?.integerValue ?? 80)
+      if !socket.connectToHost(host, port: port) { MSLogDebug("connection to '\(host)' already open or in progress") }
+    } else { MSLogError("cannot subscribe to events without a host in '\(baseURL)'") }
+  }
+
+  /** The `Subscribe` request asking for events to be posted back over the same socket */
+  private var subscribeRequest: NSData? {
+    let body = "<s:Envelope><s:Body><u:Subscribe xmlns:u=\"urn:udi-com:service:X_Insteon_Lighting_Service:1\">"
+             + "<reportURL>REUSE_SOCKET</reportURL><duration>infinite</duration></u:Subscribe></s:Body></s:Envelope>"
+    let login = "\(user):\(password)".dataUsingEncoding(NSUTF8StringEncoding)?.base64EncodedStringWithOptions(nil)
+    if let login = login, host = baseURL.host {
+      let lines = [
+        "POST /services HTTP/1.1",
+        "Host: \(host)",
+        "Authorization: Basic \(login)",
+        "Content-Type: text/xml; charset=\"utf-8\"",
+        "SOAPACTION: \"urn:udi-com:service:X_Insteon_Lighting_Service:1#Subscribe\"",
+        "Content-Length: \(count(body.utf8))"
+      ]
+      return ("\r\n".join(lines) + "\r\n\r\n" + body).dataUsingEncoding(NSUTF8StringEncoding)
+    } else { return nil }
+  }
+
+  // MARK: - Scanning
+
+  /**
+  Splits a frame into the text preceding its tag and the tag itself, both without angle brackets
+
+  :param: frame String
+
+  :returns: (text: String, tag: String)?
+  */
+  private static func textAndTagForFrame(frame: String) -> (text: String, tag: String)? {
+    if let open = frame.rangeOfString("<", options: .BackwardsSearch) {
+      let text = frame.substringToIndex(open.startIndex)
+      let tag = frame.substringWithRange(open.endIndex ..< advance(frame.endIndex, -1))
+      return (text, tag)
+    } else { return nil }
+  }
+
+  /**
+  Value of the quoted attribute `name` inside `tag`
+
+  :param: name String
+  :param: tag String
+
+  :returns: String?
+  */
+  private static func attribute(name: String, inTag tag: String) -> String? {
+    if let start = tag.rangeOfString("\(name)=\""),
+      end = tag.rangeOfString("\"", range: start.endIndex ..< tag.endIndex)
+    {
+      return tag.substringWithRange(start.endIndex ..< end.startIndex)
+    } else { return nil }
+  }
+
+  /**
+  Advances the scan by one tag
+
+  :param: text String
+  :param: tag String
+  */
+  private func scanText(text: String, tag: String) {
+    if tag.hasPrefix("Event ") || tag == "Event" {
+      inEvent = true
+      fields.removeAll(keepCapacity: true)
+      sequenceNumber = ISYEventStream.attribute("seqnum", inTag: tag)?.toInt()
+      if subscriptionID == nil { subscriptionID = ISYEventStream.attribute("sid", inTag: tag) }
+    } else if tag == "/Event" {
+      inEvent = false
+      if let control = fields["control"], node = fields["node"] {
+        eventHandler?(Event(control: control,
+                            action: fields["action"] ?? "",
+                            node: node,
+                            sequenceNumber: sequenceNumber))
+      }
+    } else if inEvent && tag.hasPrefix("/") {
+      let name = tag.substringFromIndex(advance(tag.startIndex, 1))
+      fields[name] = text.stringByTrimmingCharactersInSet(NSCharacterSet.whitespaceAndNewlineCharacterSet())
+    } else if tag == "/SID" && subscriptionID == nil {
+      subscriptionID = text
+      MSLogDebug("subscribed to events from '\(baseURL)' with SID '\(text)'")
+    }
+  }
+
+  // MARK: - NetworkDeviceConnectionDelegate
+
+  /**
+  connectionDidConnect:
+
+  :param: connection NetworkDeviceConnection
+  */
+  func connectionDidConnect(connection: NetworkDeviceConnection) {
+    inEvent = false
+    if let request = subscribeRequest { connection.writeData(request, tag: 0) }
+  }
+
+  /**
+  connection:didReceiveFrame:
+
+  :param: connection NetworkDeviceConnection
+  :param: frame NSData
+  */
+  func connection(connection: NetworkDeviceConnection, didReceiveFrame frame: NSData) {
+    if let frame = NSString(data: frame, encoding: NSUTF8StringEncoding) as? String,
+      scanned = ISYEventStream.textAndTagForFrame(frame)
+    {
+      scanText(scanned.text, tag: scanned.tag)
+    }
+  }
+
+  /**
+  connection:didWriteDataWithTag:
+
+  :param: connection NetworkDeviceConnection
+  :param: tag Int
+  */
+  func connection(connection: NetworkDeviceConnection, didWriteDataWithTag tag: Int) {}
+
+  /**
+  connectionDidDisconnect:withError:
+
+  :param: connection NetworkDeviceConnection
+  :param: error NSError?
+  */
+  func connectionDidDisconnect(connection: NetworkDeviceConnection, withError error: NSError?) {
+    subscriptionID = nil
+    if subscribed {
+      MSLogWarn("event stream for '\(baseURL)' closed, resubscribing in \(ISYEventStream.RetryInterval)s: \(toString(descriptionForError(error)))")
+      let time = dispatch_time(DISPATCH_TIME_NOW, Int64(ISYEventStream.RetryInterval * Double(NSEC_PER_SEC)))
+      dispatch_after(time, queue) { if self.subscribed { self.connect() } }
+    }
+  }
+
+}
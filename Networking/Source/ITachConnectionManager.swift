@@ -89,6 +89,15 @@ import class DataModel.NetworkDevice
     return result
   }
 
+  /**
+  Opens connections to the specified devices so that their first command does not wait on a connect
+
+  :param: devices [Device]
+  */
+  class func prewarmConnectionsForDevices(devices: [Device]) {
+    apply(devices) { ITachConnectionManager.connectionForDevice($0).prewarm() }
+  }
+
   /** Suspend active connections */
   class func suspend() {
     if detectingNetworkDevices { multicastConnection.stopListening() }
@@ -99,23 +108,22 @@ import class DataModel.NetworkDevice
   /** Resume multicast connection and any device connections that were active on suspension */
   class func resume() {
     if detectingNetworkDevices { multicastConnection.listen() }
-    apply(connections) { if ITachConnectionManager.activeConnections ∋ $0 { $1.connect() } }
+    apply(connections) { if ITachConnectionManager.activeConnections ∋ $0 { $1.prewarm() } }
   }
 
   // MARK: - Sending and receiving messages
 
   /**
-  Processes messages received through `NetworkDeviceConnection` objects.
+  Processes beacons received through the multicast connection.
 
-  :param: message String Contents of the message received by the device connection
+  :param: beacon Beacon The beacon received by the multicast connection
   */
-  class func messageReceived(message: String) {
-
-    MSLogDebug("message received over multicast connection:\n\(message)\n")
+  class func messageReceived(beacon: Beacon) {
 
-    if let uniqueIdentifier = message.stringByMatchingFirstOccurrenceOfRegEx("(?<=UUID=)[^<]+(?=>)")
-     where beaconsReceived ∌ uniqueIdentifier
-    {
+    let uniqueIdentifier = beacon.identifier
+    if beacon.kind == .AMXB && beaconsReceived ∌ uniqueIdentifier {
+      let message = beacon.message
+      MSLogDebug("message received over multicast connection:\n\(message)\n")
       assert(connections[uniqueIdentifier] == nil)
       beaconsReceived.insert(uniqueIdentifier)
 
@@ -167,15 +175,59 @@ import class DataModel.NetworkDevice
 
   :param: command ITachIRCommand The command to execute
 
+  :param: priority ConnectionManager.Priority = .Interactive The lane in which the command waits to be sent
+
   :param: completion The block to execute upon task completion
 
   */
-  class func sendCommand(command: ITachIRCommand, completion: Callback? = nil) {
-    if command.commandString.isEmpty {
+  class func sendCommand(command: ITachIRCommand,
+                priority: ConnectionManager.Priority = .Interactive,
+              completion: Callback? = nil)
+  {
+    // Cached device identifiers let repeat presses skip faulting the code, component device and network device
+    if let identifier = Connection.payloadCache.cachedDeviceIdentifierForCommand(command),
+      connection = connections[identifier]
+    {
+      connection.enqueueCommand(command, priority: priority, completion: completion)
+    }
+
+    else if command.code == nil {
       MSLogError("cannot send empty or nil command")
       completion?(false, NSError(domain: Error.domain, code: Error.CommandEmpty.rawValue, userInfo: nil))
+    }
+
+    else if let device = command.networkDevice as? Device {
+      connectionForDevice(device).enqueueCommand(command, priority: priority, completion: completion)
+    }
+  }
+
+  /**
+  Streams an IR command for as long as its button is held
+
+  :param: command ITachIRCommand The command to stream
+  :param: completion Callback? = nil The block to execute once the stream has ended
+  */
+  class func beginStreamingCommand(command: ITachIRCommand, completion: Callback? = nil) {
+    if let identifier = Connection.payloadCache.cachedDeviceIdentifierForCommand(command),
+      connection = connections[identifier]
+    {
+      connection.beginStreamingCommand(command, completion: completion)
+    } else if command.code == nil {
+      MSLogError("cannot stream empty or nil command")
+      completion?(false, NSError(domain: Error.domain, code: Error.CommandEmpty.rawValue, userInfo: nil))
     } else if let device = command.networkDevice as? Device {
-      connectionForDevice(device).enqueueCommand(command, completion: completion)
+      connectionForDevice(device).beginStreamingCommand(command, completion: completion)
+    }
+  }
+
+  /**
+  Ends a stream started with `beginStreamingCommand:completion:`
+
+  :param: command ITachIRCommand
+  */
+  class func endStreamingCommand(command: ITachIRCommand) {
+    if let identifier = Connection.payloadCache.deviceIdentifierForCommand(command), connection = connections[identifier] {
+      connection.endStreamingCommand(command)
     }
   }
 
@@ -74,18 +74,56 @@ extension ITachDeviceConnection {
     */
     case SendIR (Int, ITachIRCommand)
 
-    var expectResponse: [String] {
+    /**
+    Same as `SendIR` except that `<repeat>` is raised to `MaxRepeatCount` so that a held button streams the code from
+    its `<offset>` with a single message. The stream is cut short with `StopIR` once the button is released.
+
+    Associated values represent id and command
+    */
+    case RepeatIR (Int, ITachIRCommand)
+
+    /**
+    `stopir,<connectoraddress>↵` halts the IR transmission in progress on the connector
+
+    Sent in response: `stopir,<connectoraddress>↵`
+
+    Associated value represents port
+    */
+    case StopIR (Int)
+
+    /** Largest `<repeat>` accepted by `sendir` */
+    static let MaxRepeatCount = 50
+
+    /** Connector port addressed by the message, `ControlPort` for messages not addressed to a connector */
+    var port: Int {
       switch self {
-      case .GetDevices:
-        return ["^device[^\\r]+\\r$", "endlistdevices\\r$"]
-      case .GetNET:
-        return ["^NET[^\\r]+\\r$"]
-      case .GetIRL:
-        return ["^IR Learner (?:Enabled|Unavailable)\\r$"]
-      case .StopIRL:
-        return ["^IR Learner Disabled\\r$"]
-      case let .SendIR(id, command):
-        return ["^(?:complete|busy)ir,1:\(command.port),\(id)\\r$"]
+        case let .SendIR(_, command):   return ITachDeviceConnection.payloadCache.portForCommand(command)
+        case let .RepeatIR(_, command): return ITachDeviceConnection.payloadCache.portForCommand(command)
+        case let .StopIR(port):         return port
+        default:                        return ITachDeviceConnection.ControlPort
+      }
+    }
+
+    /**
+    Whether `response` is the last response expected for the message
+
+    :param: response Response
+
+    :returns: Bool? `nil` when `response` is not a response to this kind of message
+    */
+    func isFinalResponse(response: Response) -> Bool? {
+      switch (self, response) {
+        case (.GetDevices, .Device):                                    return false
+        case (.GetDevices, .EndListDevices):                            return true
+        case (.GetNET, .Network):                                       return true
+        case (.GetIRL, .LearnerEnabled), (.GetIRL, .LearnerUnavailable): return true
+        case (.StopIRL, .LearnerDisabled):                              return true
+        case let (.SendIR(id, _), .CompleteIR(p, i)):                   return p == port && i == id ? true : nil
+        case let (.SendIR(id, _), .BusyIR(p, i)):                       return p == port && i == id ? false : nil
+        case let (.RepeatIR(id, _), .CompleteIR(p, i)):                 return p == port && i == id ? true : nil
+        case let (.RepeatIR(id, _), .BusyIR(p, i)):                     return p == port && i == id ? false : nil
+        case let (.StopIR(port), .StopIR(p)):                           return p == port ? true : nil
+        default:                                                        return nil
       }
     }
 
@@ -101,11 +139,37 @@ extension ITachDeviceConnection {
           let repeat = command.code.repeatCount
           let offset = command.code.offset
           let pattern = command.code.onOffPattern
-          return "sendir,1:\(port),\(id),\(frequency),\(repeat),\(offset),\(pattern)\\r"
+          return "sendir,1:\(port),\(id),\(frequency),\(repeat),\(offset),\(pattern)\r"
+        case let .RepeatIR(id, command):
+          let port = command.port
+          let frequency = command.code.frequency
+          let repeat = Command.MaxRepeatCount
+          let offset = command.code.offset
+          let pattern = command.code.onOffPattern
+          return "sendir,1:\(port),\(id),\(frequency),\(repeat),\(offset),\(pattern)\r"
+        case let .StopIR(port): return "stopir,1:\(port)\r"
+      }
+    }
+
+    /** Whether there is nothing to send, `sendir` messages always have content */
+    var isEmpty: Bool {
+      switch self {
+        case .SendIR, .RepeatIR, .StopIR: return false
+        default:                          return msg.isEmpty
       }
     }
 
-    var data: NSData { return msg.dataUsingEncoding(NSUTF8StringEncoding)! }
+    /** `sendir` messages come from `payloadCache` with `<ID>` patched in, others are encoded from `msg` */
+    var data: NSData {
+      switch self {
+        case let .SendIR(id, command):
+          return ITachDeviceConnection.payloadCache.dataForCommand(command, id: id)
+        case let .RepeatIR(id, command):
+          return ITachDeviceConnection.payloadCache.dataForCommand(command, id: id, streaming: true)
+        default:
+          return msg.dataUsingEncoding(NSUTF8StringEncoding)!
+      }
+    }
   }
 
 }
\ No newline at end of file
@@ -42,58 +42,198 @@ extension ITachDeviceConnection {
     case IRConfig (Int, IRMode)
     case StopIR (Int)
 
+    /**
+    Convenience for classifying a response held in a string
+
+    :param: response String
+    */
     init?(response: String) {
-      switch response {
-        case ~/"^unknowncommand,ERR_[0-9]{2}\\r$":
-          if let err = ITachError(rawValue: response[15...20]) { self = .UnknownCommand(err) }
-          else { return nil }
-        case ~/"^IR Learner Enabled\\r$":
-          self = .LearnerEnabled
-        case ~/"^IR Learner Disabled\\r$":
-          self = .LearnerDisabled
-        case ~/"^IR Learner Unavailabler":
-          self = .LearnerUnavailable
-        case ~/"^completeir,1:[1-3],[0-9]+\\r$":
-          if let port = response[13...13].toInt(), tag = ",".split(response).last?.toInt() {
-            self = .CompleteIR(port, tag)
-          } else { return nil }
-        case ~/"^busyIR,1:[1-3],[0-9]+\\r$":
-          if let port = response[13...13].toInt(), tag = ",".split(response).last?.toInt() {
-            self = .BusyIR(port, tag)
-          } else { return nil }
-        case ~/"^IR,1:[1-3],[A-Z_]+\\r$":
-          if let port = response[5...5].toInt(), raw = ",".split(response).last, mode = IRMode(rawValue: raw) {
-            self = .IRConfig(port, mode)
-          } else { return nil }
-        case ~/"^stopir,1:[1-3]\r":
-          if let port = response[9...9].toInt() { self = StopIR(port) } else { return nil }
-        case ~/"^version,(?:[0-1],)?[0-9.]+\\r$":
-          let components = ",".split(response)
-          if components.count == 3, let module = components[1].toInt() {
-            self = .Version(module, components[2][0 ..< components[2].length - 2])
-          }
-          else if components.count == 2 { self = .Version(nil, response[8 ..< response.length - 2]) }
-          else { return nil}
-        case ~/"^endlistdevices\\r$":
-          self = .EndListDevices
-        case ~/"^device,[0-1],[0-3],[A-Z 13]+\\r$":
-          let components = ",".split(response)
-          if let module = components[1].toInt(),
-            port = components[2].toInt(),
-            type = ModuleType(rawValue: components[3][0 ..< components[3].length - 2])
-          {
+      if let data = response.dataUsingEncoding(NSUTF8StringEncoding) { self.init(data: data) }
+      else { return nil }
+    }
+
+    /**
+    Classifies a response by scanning the bytes read from the socket. No regular expressions are compiled and the
+    responses that arrive during IR traffic (`completeir`, `busyIR`, `stopir`, `unknowncommand`) are parsed without
+    allocating. Strings are only created for the payloads of `device`, `NET`, `version` and learner responses.
+
+    :param: data NSData A single response with or without its trailing carriage return
+    */
+    init?(data: NSData) {
+      var scanner = ResponseScanner(data: data)
+
+      if scanner.scan("completeir,1:") {
+        if let port = scanner.scanPort(), id = scanner.scanComma() ? scanner.scanInteger() : nil where scanner.atEnd {
+          self = .CompleteIR(port, id)
+        } else { return nil }
+      }
+
+      else if scanner.scan("busyIR,1:") {
+        if let port = scanner.scanPort(), id = scanner.scanComma() ? scanner.scanInteger() : nil where scanner.atEnd {
+          self = .BusyIR(port, id)
+        } else { return nil }
+      }
+
+      else if scanner.scan("stopir,1:") {
+        if let port = scanner.scanPort() where scanner.atEnd { self = .StopIR(port) } else { return nil }
+      }
+
+      else if scanner.scan("unknowncommand,ERR_") {
+        if let code = scanner.scanInteger(), err = ITachError(code: code) where scanner.atEnd {
+          self = .UnknownCommand(err)
+        } else { return nil }
+      }
+
+      else if scanner.scan("IR Learner ") {
+        if scanner.scan("Enabled") && scanner.atEnd { self = .LearnerEnabled }
+        else if scanner.scan("Disabled") && scanner.atEnd { self = .LearnerDisabled }
+        else if scanner.scan("Unavailable") && scanner.atEnd { self = .LearnerUnavailable }
+        else { return nil }
+      }
+
+      else if scanner.scan("IR,1:") {
+        if let port = scanner.scanPort(), mode = scanner.scanComma() ? IRMode(rawValue: scanner.remainder) : nil {
+          self = .IRConfig(port, mode)
+        } else { return nil }
+      }
+
+      else if scanner.scan("endlistdevices") {
+        if scanner.atEnd { self = .EndListDevices } else { return nil }
+      }
+
+      else if scanner.scan("device,") {
+        // `device,<module>,<count> <type>` where the count is part of the type for connector modules
+        if let module = scanner.scanInteger(), port = scanner.scanComma() ? scanner.scanInteger() : nil {
+          let typeString = scanner.remainder
+          let trimmed = typeString.isEmpty ? typeString : typeString[1 ..< typeString.length]
+          if let type = ModuleType(rawValue: "\(port) \(trimmed)") ?? ModuleType(rawValue: trimmed) {
             self = .Device(module, port, type)
           } else { return nil }
-        case ~/"^NET,0:1,(?:UN)?LOCKED,(?:DHCP|STATIC),[0-9.]+,[0-9.]+,[0-9]+\\r$":
-          let components = ",".split(response[0 ..< response.length - 2])
-          self = .Network(components[2] == "LOCKED", components[3], components[4], components[5], components[6])
-        case ~/"^sendir.*\\r$":
-          self = .CapturedCommand(response)
-        default:
-          return nil
+        } else { return nil }
+      }
+
+      else if scanner.scan("NET,0:1,") {
+        let components = ",".split(scanner.remainder)
+        if components.count == 5 {
+          self = .Network(components[0] == "LOCKED", components[1], components[2], components[3], components[4])
+        } else { return nil }
+      }
+
+      else if scanner.scan("version,") {
+        let components = ",".split(scanner.remainder)
+        switch components.count {
+          case 2: if let module = components[0].toInt() { self = .Version(module, components[1]) } else { return nil }
+          case 1: self = .Version(nil, components[0])
+          default: return nil
+        }
+      }
+
+      else if scanner.scan("sendir,") {
+        self = .CapturedCommand(scanner.string)
       }
+
+      else { return nil }
+    }
+
+  }
+
+}
+
+/** Scans an iTach response in place, the trailing carriage return and/or line feed are ignored */
+private struct ResponseScanner {
+
+  static let CR = UInt8(ascii: "\r")
+  static let LF = UInt8(ascii: "\n")
+  static let Comma = UInt8(ascii: ",")
+  static let Zero = UInt8(ascii: "0")
+  static let Nine = UInt8(ascii: "9")
+
+  let bytes: UnsafePointer<UInt8>
+  let length: Int
+  var location = 0
+
+  var atEnd: Bool { return location == length }
+
+  /**
+  initWithData:
+
+  :param: data NSData
+  */
+  init(data: NSData) {
+    bytes = UnsafePointer<UInt8>(data.bytes)
+    var length = data.length
+    while length > 0 && (bytes[length - 1] == ResponseScanner.CR || bytes[length - 1] == ResponseScanner.LF) { length-- }
+    self.length = length
+  }
+
+  /** The entire response without the trailing carriage return */
+  var string: String {
+    if let string = NSString(bytes: bytes, length: length, encoding: NSUTF8StringEncoding) { return string as String }
+    else { return "" }
+  }
+
+  /** Everything after the current location */
+  var remainder: String {
+    if let string = NSString(bytes: bytes + location, length: length - location, encoding: NSUTF8StringEncoding) {
+      return string as String
+    } else { return "" }
+  }
+
+  /**
+  Advances past `literal` if the bytes at the current location match
+
+  :param: literal StaticString
+
+  :returns: Bool
+  */
+  mutating func scan(literal: StaticString) -> Bool {
+    let count = Int(literal.byteSize)
+    if length - location < count { return false }
+    if memcmp(bytes + location, literal.utf8Start, count) != 0 { return false }
+    location += count
+    return true
+  }
+
+  /**
+  scanComma
+
+  :returns: Bool
+  */
+  mutating func scanComma() -> Bool {
+    if location < length && bytes[location] == ResponseScanner.Comma { location++; return true }
+    return false
+  }
+
+  /**
+  Scans a run of decimal digits, a run whose value does not fit in an `Int` is consumed but yields `nil`
+
+  :returns: Int?
+  */
+  mutating func scanInteger() -> Int? {
+    let start = location
+    var value = 0
+    var overflow = false
+    while location < length && bytes[location] >= ResponseScanner.Zero && bytes[location] <= ResponseScanner.Nine {
+      let (product, productOverflow) = Int.multiplyWithOverflow(value, 10)
+      let (sum, sumOverflow) = Int.addWithOverflow(product, Int(bytes[location] - ResponseScanner.Zero))
+      overflow = overflow || productOverflow || sumOverflow
+      value = sum
+      location++
     }
+    return location > start && !overflow ? value : nil
+  }
+
+  /**
+  Scans a single connector port digit between 1 and 3
 
+  :returns: Int?
+  */
+  mutating func scanPort() -> Int? {
+    if location < length {
+      let port = Int(bytes[location]) - Int(ResponseScanner.Zero)
+      if 1 ... 3 ~= port { location++; return port }
+    }
+    return nil
   }
 
-}
\ No newline at end of file
+}
@@ -0,0 +1,206 @@
+//
+//  ITachDeviceConnection.PayloadCache.swift
+//  Remote
+//
+//  Created by Jason Cardwell on 5/16/15.
+//  Copyright (c) 2015 Moondeer Studios. All rights reserved.
+//
+
+import Foundation
+import CoreData
+import MoonKit
+import class DataModel.IRCode
+import class DataModel.ITachIRCommand
+import class DataModel.ComponentDevice
+import class DataModel.NetworkDevice
+import class DataModel.ITachDevice
+
+extension ITachDeviceConnection {
+
+  /**
+  Caches the encoded `sendir` message for each `ITachIRCommand` so repeat presses do not rebuild the string or fault
+  the command's code. The `<ID>` field is encoded as a fixed width run of digits that is patched in place for each
+  send. Entries are keyed by the command's object ID and are rebuilt when the version recorded for the command's
+  code no longer matches, versions being bumped whenever a context reports a change to the code.
+  */
+  final class PayloadCache {
+
+    /** Width of the zero padded `<ID>` field, wide enough for the largest ID of 65535 */
+    static let IDFieldWidth = 5
+
+    private struct Entry {
+      let template: NSData
+      let streamingTemplate: NSData
+      let idOffset: Int
+      let port: Int
+      let deviceIdentifier: String?
+      let codeID: NSManagedObjectID
+      let codeVersion: Int
+    }
+
+    private var entries: [NSManagedObjectID:Entry] = [:]
+    private var codeVersions: [NSManagedObjectID:Int] = [:]
+    private let queue = dispatch_queue_create("com.moondeerstudios.remote.itach.payloads", DISPATCH_QUEUE_SERIAL)
+
+    /** Bumps code versions and drops entries as model objects change */
+    private var changeReceptionist: MSNotificationReceptionist?
+
+    init() {
+      changeReceptionist = MSNotificationReceptionist(observer: self,
+                                                     forObject: nil,
+                                              notificationName: NSManagedObjectContextObjectsDidChangeNotification,
+                                                         queue: nil,
+                                                       handler: {
+                                                         (receptionist: MSNotificationReceptionist!) -> Void in
+                                                           if let cache = receptionist.observer as? PayloadCache {
+                                                             cache.objectsDidChange(receptionist.notification.userInfo)
+                                                           }
+                                                       })
+    }
+
+    /**
+    Returns the message for `command` with `id` written into its `<ID>` field
+
+    :param: command ITachIRCommand
+    :param: id Int
+    :param: streaming Bool = false Whether to use `MaxRepeatCount` in place of the code's repeat count
+
+    :returns: NSData
+    */
+    func dataForCommand(command: ITachIRCommand, id: Int, streaming: Bool = false) -> NSData {
+      let entry = entryForCommand(command)
+      let template = streaming ? entry.streamingTemplate : entry.template
+      let data = NSMutableData(length: template.length)!
+      memcpy(data.mutableBytes, template.bytes, template.length)
+
+      var digits = UnsafeMutablePointer<UInt8>(data.mutableBytes) + entry.idOffset
+      var value = max(0, id) % MessageTagTable<Command>.MaxTag
+      for i in reverse(0 ..< PayloadCache.IDFieldWidth) {
+        digits[i] = UInt8(ascii: "0") + UInt8(value % 10)
+        value /= 10
+      }
+      return data
+    }
+
+    /**
+    Port of the connector addressed by `command`, read from the cache when possible
+
+    :param: command ITachIRCommand
+
+    :returns: Int
+    */
+    func portForCommand(command: ITachIRCommand) -> Int { return entryForCommand(command).port }
+
+    /**
+    Unique identifier of the iTach addressed by `command`, read from the cache when possible
+
+    :param: command ITachIRCommand
+
+    :returns: String?
+    */
+    func deviceIdentifierForCommand(command: ITachIRCommand) -> String? {
+      return entryForCommand(command).deviceIdentifier
+    }
+
+    /**
+    Unique identifier of the iTach addressed by `command` when the cache holds a current entry for it, a miss returns
+    `nil` without building an entry so nothing about the command is faulted in
+
+    :param: command ITachIRCommand
+
+    :returns: String?
+    */
+    func cachedDeviceIdentifierForCommand(command: ITachIRCommand) -> String? {
+      return cachedEntryForCommand(command)?.deviceIdentifier
+    }
+
+    /** Removes all cached messages */
+    func removeAll() { dispatch_sync(queue) { self.entries.removeAll() } }
+
+    /**
+    Returns the cached entry for `command`, building it if missing or stale
+
+    :param: command ITachIRCommand
+
+    :returns: Entry
+    */
+    private func entryForCommand(command: ITachIRCommand) -> Entry {
+      if let entry = cachedEntryForCommand(command) { return entry }
+      let entry = buildEntryForCommand(command)
+      dispatch_sync(queue) { self.entries[command.objectID] = entry }
+      return entry
+    }
+
+    /**
+    Returns the cached entry for `command` unless it is missing or stale
+
+    :param: command ITachIRCommand
+
+    :returns: Entry?
+    */
+    private func cachedEntryForCommand(command: ITachIRCommand) -> Entry? {
+      let commandID = command.objectID
+      var result: Entry?
+      dispatch_sync(queue) {
+        if let entry = self.entries[commandID] where (self.codeVersions[entry.codeID] ?? 0) == entry.codeVersion {
+          result = entry
+        }
+      }
+      return result
+    }
+
+    /**
+    Encodes `command` as `sendir,1:<port>,<ID>,<frequency>,<repeat>,<offset>,<pattern>↵` with a zeroed `<ID>` field
+
+    :param: command ITachIRCommand
+
+    :returns: Entry
+    */
+    private func buildEntryForCommand(command: ITachIRCommand) -> Entry {
+      let code = command.code
+      let port = Int(command.port)
+      let prefix = "sendir,1:\(port),"
+      let idField = String(count: PayloadCache.IDFieldWidth, repeatedValue: Character("0"))
+      let suffix = ",\(code.frequency),\(code.repeatCount),\(code.offset),\(code.onOffPattern)\r"
+      let streamingSuffix = ",\(code.frequency),\(Command.MaxRepeatCount),\(code.offset),\(code.onOffPattern)\r"
+      let template = (prefix + idField + suffix).dataUsingEncoding(NSUTF8StringEncoding)!
+      let streamingTemplate = (prefix + idField + streamingSuffix).dataUsingEncoding(NSUTF8StringEncoding)!
+      var codeVersion = 0
+      dispatch_sync(queue) { codeVersion = self.codeVersions[code.objectID] ?? 0 }
+      return Entry(template: template,
+                   streamingTemplate: streamingTemplate,
+                   idOffset: count(prefix.utf8),
+                   port: port,
+                   deviceIdentifier: (command.networkDevice as? ITachDevice)?.uniqueIdentifier,
+                   codeID: code.objectID,
+                   codeVersion: codeVersion)
+    }
+
+    /**
+    Bumps the version of changed codes, drops entries for changed commands and drops everything when a device changes
+    since ports and device identifiers are baked into the entries
+
+    :param: userInfo [NSObject:AnyObject]?
+    */
+    private func objectsDidChange(userInfo: [NSObject:AnyObject]?) {
+      if userInfo == nil { return }
+      var objects: [NSManagedObject] = []
+      for key in [NSUpdatedObjectsKey, NSDeletedObjectsKey, NSRefreshedObjectsKey, NSInvalidatedObjectsKey] {
+        if let changed = userInfo![key] as? Set<NSManagedObject> { objects += Array(changed) }
+      }
+      if objects.isEmpty { return }
+      dispatch_sync(queue) {
+        for object in objects {
+          if object is IRCode { self.codeVersions[object.objectID] = (self.codeVersions[object.objectID] ?? 0) + 1 }
+          else if object is ITachIRCommand { self.entries.removeValueForKey(object.objectID) }
+          else if object is ComponentDevice || object is NetworkDevice { self.entries.removeAll(); break }
+        }
+      }
+    }
+
+  }
+
+  /** Shared cache of encoded `sendir` messages */
+  static let payloadCache = PayloadCache()
+
+}
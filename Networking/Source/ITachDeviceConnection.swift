@@ -20,8 +20,15 @@ import MoonKit
  Messages to be sent to the device are received from the connection manager and messages received
  from the iTach device are passed up to the connection manager.
 
+ Messages are buffered per port. When `pipelined` is `true`, each connector address (`1:1` through `1:3`) and the
+ control port may have one message awaiting a response at the same time, so a long transmission on one port does not
+ hold up the messages for another. Replies are matched to their message by port and ID rather than by read order.
+
+ Each port's buffer is split into priority lanes. Button presses go before macro commands, and maintenance messages
+ (discovery and learner control) are held back while any button press is waiting or awaiting a response.
+
  */
-@objc class ITachDeviceConnection: GCDAsyncSocketDelegate {
+@objc class ITachDeviceConnection: NetworkDeviceConnectionDelegate {
 
   typealias Callback = ConnectionManager.Callback
 
@@ -29,36 +36,66 @@ import MoonKit
 
   static let TagKey = "tag"
   static let PortKey = "port"
-  static let ExpectResponseKey = "expectResponse"
+  static let RetryCountKey = "retryCount"
+  static let PriorityKey = "priority"
 
   static let TCPPort: UInt16 = 4998
 
+  /** Port used for messages that are not addressed to a connector, i.e. `getdevices`, `get_NET`, etc. */
+  static let ControlPort = 0
+
+  /** Number of times a `sendir` is resent after a `busyIR` response before failing */
+  static let MaxBusyRetries = 5
+
+  /** Seconds to wait before resending a `sendir` that received a `busyIR` response */
+  static let BusyRetryDelay = 0.05
+
+  /** Maximum number of messages tracked at once, messages still unanswered when their slot is reused are orphans */
+  static let TagTableCapacity = 64
+
+  /** Seconds a message may go without changing state before it is failed */
+  static let ResponseTimeout: CFTimeInterval = 10
+
   typealias Error = ConnectionManager.Error
+  typealias Priority = ConnectionManager.Priority
 
-  static let ITachQueue = dispatch_queue_create("com.moondeerstudios.remote.itach", DISPATCH_QUEUE_CONCURRENT)
+  /** Serial so that socket callbacks and queue manipulation never interleave */
+  static let ITachQueue = dispatch_queue_create("com.moondeerstudios.remote.itach", DISPATCH_QUEUE_SERIAL)
 
   // MARK: - Instance properties
 
-  /** Messages being sent */
-  private var messagesSending: OrderedDictionary<Int, MessageQueueEntry<Command>> = [:]
+  /** Messages being sent or awaiting a response keyed by tag */
+  private var messages = MessageTagTable<Command>(capacity: ITachDeviceConnection.TagTableCapacity)
 
-  /** Messages awaiting response */
-  private var messagesSent: OrderedDictionary<Int, MessageQueueEntry<Command>> = [:]
+  /** Fires periodically while connected to expire messages that never received a response */
+  private var timeoutTimer: dispatch_source_t?
 
   /** Connection in progress */
   private(set) var connecting = false { willSet { if newValue && connecting { MSLogWarn("already connecting") } } }
 
-  /** Model for device */
-  let device: ITachDevice
+  /** The device's UUID, which identifies the connection */
+  let uniqueIdentifier: String
+
+  /** Host of the device, copied so that connecting never reads the device off its context's queue */
+  let configURL: String
+
+  /** Whether messages for different ports may be awaiting responses at the same time */
+  var pipelined = true
 
-  /** Message send buffer */
-  private var messageQueue: Queue<MessageQueueEntry<Command>> = Queue()
+  /** Message send buffers keyed by port and split by priority */
+  private var messageLanes = MessageLanes<Command>()
 
-  /** Connection to device */
-  private let socket: GCDAsyncSocket
+  /** Tags of the messages awaiting responses keyed by port */
+  private var inFlightTags: [Int:Int] = [:]
 
-  /** Current tag for new messages */
-  private var currentTag: Int = 0
+  /** Commands streaming while their button is held keyed by port */
+  private var streamingCommands: [Int:ITachIRCommand] = [:]
+
+  /** Ports with a `stopir` written whose reply has yet to arrive */
+  private var pendingStops: Set<Int> = []
+
+  /** Connection to device, responses are framed on carriage returns */
+  private let socket: NetworkDeviceConnection
 
   /** Executed on connect */
   private var connectCallback: Callback?
@@ -85,101 +122,367 @@ import MoonKit
   // MARK: - Initialization
 
   /**
-  initWithDevice:
+  Copies what the connection needs from `device`, must be invoked on the queue of the device's context
 
-  :param: device ITachDevice
+  :param: d ITachDevice
   */
   init(device d: ITachDevice) {
-    device = d
-    socket = GCDAsyncSocket()
-    socket.setDelegate(self, delegateQueue: ITachDeviceConnection.ITachQueue)
+    uniqueIdentifier = d.uniqueIdentifier
+    configURL = d.configURL ?? ""
+    socket = NetworkDeviceConnection(delegateQueue: ITachDeviceConnection.ITachQueue)
+    socket.delegate = self
   }
 
   // MARK: - Sending and Receiving
 
-  /** sendNextMessage */
+  /**
+  Sends the next queued message for every port without a message awaiting a response. When not pipelined, the port
+  whose next message has the highest priority goes first.
+  */
   func sendNextMessage() {
-    if !connected { MSLogError("cannot send messages without a socket connection") }
+    if !connected { MSLogError("cannot send messages without a socket connection"); return }
 
-    else if var entry = messageQueue.dequeue() {
+    let lanes: [Priority] = holdMaintenance ? [.Interactive, .Macro] : Priority.allValues
+    if pipelined {
+      for port in messageLanes.ports { if inFlightTags[port] == nil { sendNextEntryForPort(port, lanes: lanes) } }
+    } else {
+      while inFlightTags.isEmpty {
+        var next: (port: Int, lane: Priority)?
+        for port in messageLanes.ports {
+          if let lane = messageLanes.laneForPort(port, lanes: lanes)
+            where next == nil || lane.rawValue < next!.lane.rawValue { next = (port, lane) }
+        }
+        if next == nil { break }
+        sendNextEntryForPort(next!.port, lanes: lanes)
+      }
+    }
+  }
 
-      let tag = currentTag++ // Should be the ONLY place the tag is incremented
+  /** Whether maintenance messages must wait because a button press is queued or awaiting a response */
+  private var holdMaintenance: Bool {
+    if messageLanes.countForLane(.Interactive) > 0 { return true }
+    for tag in inFlightTags.values {
+      if let entry = messages.entryForTag(tag), rawValue = entry.userInfo[ITachDeviceConnection.PriorityKey] as? Int
+        where Priority(rawValue: rawValue) == .Interactive { return true }
+    }
+    return false
+  }
 
-      var message = entry.messageData
+  /**
+  Sends the highest priority message queued for `port` among the specified lanes
 
-      switch message {
-        case .SendIR(_, let command): message = .SendIR(tag, command)
+  :param: port Int
+  :param: lanes [Priority]
+  */
+  private func sendNextEntryForPort(port: Int, lanes: [Priority]) {
+    while let next = messageLanes.dequeueForPort(port, lanes: lanes) {
+      let entry = next.0
+      // Streams released before their message went out have nothing left to do
+      switch entry.messageData {
+        case .RepeatIR(_, let command) where streamingCommands[port] !== command:
+          entry.completion?(true, nil)
+          continue
         default: break
       }
+      sendEntry(entry, port: port)
+      break
+    }
+  }
 
-      entry.messageData = message
+  /**
+  Assigns a tag to the entry and writes it to the socket
 
-      // Send the message
-      receiveNextMessage(tag: tag)
-      socket.writeData(entry.data, withTimeout: -1, tag: tag)
-      messagesSending[tag] = entry
+  :param: entry MessageQueueEntry<Command>
+  :param: port Int
+  */
+  private func sendEntry(var entry: MessageQueueEntry<Command>, port: Int) {
+    let (tag, orphan) = messages.insert(entry) // Should be the ONLY place a tag is assigned
+
+    if let orphan = orphan {
+      MSLogWarn("evicting orphaned message '\(orphan.message)'")
+      let orphanPort = orphan.messageData.port
+      if let orphanTag = inFlightTags[orphanPort] where messages.entryForTag(orphanTag) == nil {
+        inFlightTags.removeValueForKey(orphanPort)
+      }
+      orphan.completion?(false, Error.ResponseTimeout.error())
     }
 
-    else { receiveNextMessage() }
+    switch entry.messageData {
+      case .SendIR(_, let command):
+        entry.messageData = .SendIR(tag, command)
+        messages.setState(.Sending, forTag: tag, entry: entry)
+      case .RepeatIR(_, let command):
+        entry.messageData = .RepeatIR(tag, command)
+        messages.setState(.Sending, forTag: tag, entry: entry)
+      default: break
+    }
 
+    inFlightTags[port] = tag
+    socket.writeData(entry.data, tag: tag)
   }
 
   /**
-  receiveNextMessage:
+  enqueueCommand:priority:completion:
 
-  :param: tag Int = -1
+  :param: command ITachIRCommand
+  :param: priority Priority = .Interactive
+  :param: completion Callback? = nil
   */
-  func receiveNextMessage(tag: Int = -1) {
-    if connected {
-      socket.readDataToData(GCDAsyncSocket.CRData(),
-                withTimeout: -1,
-                     buffer: nil,
-               bufferOffset: 0,
-                  maxLength: 0,
-                        tag: tag)
-    }
+  func enqueueCommand(command: ITachIRCommand, priority: Priority = .Interactive, completion: Callback? = nil) {
+    let port = ITachDeviceConnection.payloadCache.portForCommand(command)
+    enqueueEntry(MessageQueueEntry(messageData: .SendIR(-1, command),
+                                   userInfo: [ITachDeviceConnection.PortKey:port,
+                                              ITachDeviceConnection.PriorityKey:priority.rawValue],
+                                   completion: completion),
+                 priority: priority)
   }
 
+  /**
+  Streams `command` until `endStreamingCommand:` is invoked. A single `sendir` goes out with `MaxRepeatCount` repeats,
+  another follows each `completeir` while the stream lasts, and `stopir` cuts the transmission short on release.
+
+  :param: command ITachIRCommand
+  :param: completion Callback? = nil Invoked once the stream has ended
+  */
+  func beginStreamingCommand(command: ITachIRCommand, completion: Callback? = nil) {
+    let port = ITachDeviceConnection.payloadCache.portForCommand(command)
+    dispatch_async(ITachDeviceConnection.ITachQueue) {
+      [unowned self] in self.streamingCommands[port] = command
+    }
+    enqueueEntry(MessageQueueEntry(messageData: .RepeatIR(-1, command),
+                                   userInfo: [ITachDeviceConnection.PortKey:port,
+                                              ITachDeviceConnection.PriorityKey:Priority.Interactive.rawValue],
+                                   completion: completion),
+                 priority: .Interactive)
+  }
 
   /**
-  enqueueCommand:completion:
+  Ends the stream for `command`, halting the transmission in progress with `stopir`
 
   :param: command ITachIRCommand
-  :param: completion Callback? = nil
   */
-  func enqueueCommand(command: ITachIRCommand, completion: Callback? = nil) {
-    enqueueEntry(MessageQueueEntry(messageData: .SendIR(-1, command),
-                                   userInfo: [ITachDeviceConnection.PortKey:Int(command.port)],
-                                   completion: completion))
+  func endStreamingCommand(command: ITachIRCommand) {
+    let port = ITachDeviceConnection.payloadCache.portForCommand(command)
+    dispatch_async(ITachDeviceConnection.ITachQueue) {
+      [unowned self] in
+      if self.streamingCommands[port] !== command { return }
+      self.streamingCommands.removeValueForKey(port)
+      if let tag = self.inFlightTags[port], entry = self.messages.entryForTag(tag) {
+        switch entry.messageData {
+          // Written directly since the port's queue is held up by the very transmission being stopped
+          case .RepeatIR where self.connected:
+            self.pendingStops.insert(port)
+            self.socket.writeData(Command.StopIR(port).data, tag: -1)
+          default: break
+        }
+      }
+    }
+  }
+
+  /**
+  Queues the next `sendir` for a stream that is still held once the previous one has completed
+
+  :param: port Int
+
+  :returns: Bool Whether the stream continues, in which case the completed entry's completion is carried forward
+  */
+  private func continueStreamForPort(port: Int) -> Bool {
+    if let command = streamingCommands[port], tag = inFlightTags[port], entry = messages.entryForTag(tag) {
+      switch entry.messageData {
+        case .RepeatIR(_, let streamed) where streamed === command:
+          inFlightTags.removeValueForKey(port)
+          messages.removeEntryForTag(tag)
+          messageLanes.enqueue(MessageQueueEntry(messageData: .RepeatIR(-1, command),
+                                                 userInfo: entry.userInfo,
+                                                 completion: entry.completion),
+                               port: port,
+                               lane: .Interactive,
+                            bounded: false)
+          sendNextMessage()
+          return true
+        default: break
+      }
+    }
+    return false
+  }
+
+  /**
+  Whether the message awaiting a response on `port` is part of a stream
+
+  :param: port Int
+
+  :returns: Bool
+  */
+  private func isStreamingEntryForPort(port: Int) -> Bool {
+    if let tag = inFlightTags[port], entry = messages.entryForTag(tag) {
+      switch entry.messageData { case .RepeatIR: return true; default: return false }
+    }
+    return false
   }
 
   /**
-  enqueueCommand:completion:
+  enqueueCommand:priority:completion:
 
   :param: command Command
+  :param: priority Priority = .Maintenance
   :param: completion Callback? = nil
   */
-  func enqueueCommand(command: Command, completion: Callback? = nil) {
+  func enqueueCommand(command: Command, priority: Priority = .Maintenance, completion: Callback? = nil) {
     enqueueEntry(MessageQueueEntry(messageData: command,
-                                   userInfo: [ITachDeviceConnection.ExpectResponseKey: command.expectResponse],
-                                   completion: completion))
+                                   userInfo: [ITachDeviceConnection.PriorityKey: priority.rawValue],
+                                   completion: completion),
+                 priority: priority)
+  }
+
+  /**
+  Sets the number of messages that may wait in the specified lane, messages beyond the bound fail with `QueueFull`
+
+  :param: bound Int
+  :param: priority Priority
+  */
+  func setBound(bound: Int, forPriority priority: Priority) {
+    dispatch_async(ITachDeviceConnection.ITachQueue) { [unowned self] in self.messageLanes.bounds[priority] = bound }
   }
 
   /**
-  enqueueEntry:completion:
+  enqueueEntry:priority:
 
   :param: entry MessageQueueEntry
+  :param: priority Priority
   */
-  private func enqueueEntry(entry: MessageQueueEntry<Command>) {
-    if entry.message.isEmpty {
+  private func enqueueEntry(entry: MessageQueueEntry<Command>, priority: Priority) {
+    if entry.messageData.isEmpty {
       entry.completion?(false, Error.CommandEmpty.error())
     } else {
-      messageQueue.enqueue(entry)
-      if (!connected || connecting) { connect() {[unowned self] success, _ in if success { self.sendNextMessage() } } }
-      else { sendNextMessage() }
+      let port = entry.messageData.port
+      dispatch_async(ITachDeviceConnection.ITachQueue) {
+        [unowned self] in
+        switch self.messageLanes.enqueue(entry, port: port, lane: priority) {
+          case .Refused:
+            MSLogWarn("lane \(priority.rawValue) is full, refusing '\(entry.message)'")
+            entry.completion?(false, Error.QueueFull.error())
+            return
+          case .Coalesced:
+            return
+          case .Enqueued:
+            break
+        }
+        if (!self.connected || self.connecting) {
+          self.connect() {[unowned self] success, _ in if success { self.sendNextMessage() } }
+        }
+        else { self.sendNextMessage() }
+      }
     }
   }
 
+  /**
+  Removes the entry awaiting a response on the specified port, invoking its completion
+
+  :param: port Int
+  :param: success Bool
+  :param: error NSError?
+  */
+  private func completeEntryForPort(port: Int, success: Bool, error: NSError?) {
+    if let tag = inFlightTags.removeValueForKey(port) {
+      messages.removeEntryForTag(tag)?.completion?(success, error)
+    }
+    sendNextMessage()
+  }
+
+  /**
+  Resends the `sendir` awaiting a response on the specified port after a short delay, failing the entry once
+  `MaxBusyRetries` has been reached
+
+  :param: port Int
+  */
+  private func retryEntryForPort(port: Int) {
+    if let tag = inFlightTags[port], var entry = messages.entryForTag(tag) {
+      let retryCount = ((entry.userInfo[ITachDeviceConnection.RetryCountKey] as? Int) ?? 0) + 1
+      if retryCount > ITachDeviceConnection.MaxBusyRetries {
+        completeEntryForPort(port, success: false, error: Error.NetworkDeviceError.error(
+          userInfo: [NSLocalizedFailureReasonErrorKey: "Port 1:\(port) remained busy"]))
+      } else {
+        entry.userInfo[ITachDeviceConnection.RetryCountKey] = retryCount
+        messages.setState(.Sending, forTag: tag, entry: entry)
+        let delay = dispatch_time(DISPATCH_TIME_NOW, Int64(ITachDeviceConnection.BusyRetryDelay * Double(NSEC_PER_SEC)))
+        dispatch_after(delay, ITachDeviceConnection.ITachQueue) {
+          [unowned self] in
+          if self.connected { self.socket.writeData(entry.data, tag: tag) }
+        }
+      }
+    }
+  }
+
+  /**
+  Completes the message awaiting a response on the control port if `response` is the last one it expects
+
+  :param: response Response
+  */
+  private func handleControlResponse(response: Response) {
+    let port = ITachDeviceConnection.ControlPort
+    if let tag = inFlightTags[port], entry = messages.entryForTag(tag) where messages.stateForTag(tag) == .Sent {
+      if entry.messageData.isFinalResponse(response) == true { completeEntryForPort(port, success: true, error: nil) }
+    }
+  }
+
+  /**
+  The iTach does not identify the message an error belongs to. Errors are reported as soon as a message has been
+  parsed, so the error is attributed to the oldest message written that has not received a response.
+
+  :param: error ITachError
+  */
+  private func handleError(error: ITachError) {
+    var oldest: (port: Int, timestamp: CFAbsoluteTime)?
+    for (port, tag) in inFlightTags {
+      if messages.stateForTag(tag) != .Sent { continue }
+      if let timestamp = messages.timestampForTag(tag) where oldest == nil || timestamp < oldest!.timestamp {
+        oldest = (port, timestamp)
+      }
+    }
+    if let port = oldest?.port {
+      completeEntryForPort(port, success: false, error: Error.NetworkDeviceError.error(
+        userInfo: [NSLocalizedFailureReasonErrorKey:error.reason]))
+    }
+  }
+
+  /** Fails any message that has gone `ResponseTimeout` seconds without changing state and frees its port */
+  private func expireStaleEntries() {
+    let expired = messages.removeEntriesOlderThan(ITachDeviceConnection.ResponseTimeout)
+    if expired.isEmpty { return }
+    for (tag, entry) in expired {
+      MSLogWarn("message with tag '\(tag)' timed out waiting for a response")
+      let port = entry.messageData.port
+      if inFlightTags[port] == tag { inFlightTags.removeValueForKey(port) }
+      entry.completion?(false, Error.ResponseTimeout.error())
+    }
+    sendNextMessage()
+  }
+
+  /** Starts the timer that expires stale messages */
+  private func startTimeoutTimer() {
+    if timeoutTimer != nil { return }
+    let timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, ITachDeviceConnection.ITachQueue)
+    dispatch_source_set_timer(timer, dispatch_time(DISPATCH_TIME_NOW, Int64(NSEC_PER_SEC)), NSEC_PER_SEC, NSEC_PER_SEC / 4)
+    dispatch_source_set_event_handler(timer) { [unowned self] in self.expireStaleEntries() }
+    dispatch_resume(timer)
+    timeoutTimer = timer
+  }
+
+  /** Cancels the timer that expires stale messages */
+  private func stopTimeoutTimer() {
+    if let timer = timeoutTimer { dispatch_source_cancel(timer); timeoutTimer = nil }
+  }
+
+  /**
+  Fails all messages awaiting responses, used when the connection is lost
+
+  :param: error NSError?
+  */
+  private func failInFlightEntries(error: NSError?) {
+    inFlightTags.removeAll()
+    for (_, entry) in messages.removeAll() { entry.completion?(false, error) }
+  }
+
   // MARK: - Connecting
 
   /**
@@ -198,136 +501,131 @@ import MoonKit
       connecting = true
       connectCallback = completion
 
-      var error: NSError?
-      socket.connectToHost(device.configURL, onPort:ITachDeviceConnection.TCPPort, error: &error)
-      if error != nil {
-        completion?(false, error)
+      if !socket.connectToHost(configURL, port: ITachDeviceConnection.TCPPort) {
+        connecting = false
+        completion?(false, Error.ConnectionInProgress.error())
         connectCallback = nil
       }
     }
   }
 
+  /** Opens the connection ahead of the first message unless it is already open or opening */
+  func prewarm() {
+    dispatch_async(ITachDeviceConnection.ITachQueue) {
+      [unowned self] in if !(self.connected || self.connecting) { self.connect() }
+    }
+  }
+
   /**
-  disconnect:
+  Closes the connection, a connect still in progress is cancelled and its completion reports the failure
 
   :param: completion Callback? = nil
   */
   func disconnect(completion: Callback? = nil) {
-    if connected {
-      disconnectCallback = completion
-      socket.disconnectAfterReadingAndWriting()
-    } else {
-      completion?(true, nil)
+    dispatch_async(ITachDeviceConnection.ITachQueue) {
+      [unowned self] in
+      if self.connected || self.connecting {
+        self.disconnectCallback = completion
+        self.socket.disconnect()
+      } else {
+        completion?(true, nil)
+      }
     }
   }
 
-  // MARK: - GCGAsyncSocketDelegate
+  // MARK: - NetworkDeviceConnectionDelegate
 
   /**
-  socket:didConnectToHost:port:
+  connectionDidConnect:
 
-  :param: sock GCDAsyncSocket
-  :param: host String
-  :param: port UInt16
+  :param: connection NetworkDeviceConnection
   */
-  func socket(sock: GCDAsyncSocket, didConnectToHost host: String, port: UInt16) {
-    MSLogDebug("connected to host '\(host)' over port '\(port)'")
+  func connectionDidConnect(connection: NetworkDeviceConnection) {
+    MSLogDebug("connected to host '\(configURL)' over port '\(ITachDeviceConnection.TCPPort)'")
     connecting = false
     connected = true
     connectCallback?(true, nil)
     connectCallback = nil
 
+    startTimeoutTimer()
     sendNextMessage()
   }
 
   /**
-  socket:didReadData:withTag:
+  connection:didReceiveFrame:
 
-  :param: sock GCDAsyncSocket
+  :param: connection NetworkDeviceConnection
   :param: data NSData
-  :param: tag Int
   */
-  func socket(sock: GCDAsyncSocket, didReadData data: NSData, withTag tag: Int) {
-    // TODO: Tag numbers are still getting all out of whack
+  func connection(connection: NetworkDeviceConnection, didReceiveFrame data: NSData) {
 
-    let message = NSString(data: data) as String
-
-    let completion: Callback?
-    let entry: MessageQueueEntry? = messagesSent[tag]
-    let expected = entry?.messageData.expectResponse
-
-
-    if let expect = expected?.first where expected!.count == 1 && message ~= ~/expect {
-      completion = messagesSent.removeValueForKey(tag)?.completion
-    } else if let expect = expected?.first where expected!.count == 2 && message ~= ~/expect {
-      completion = nil
-    } else if let expect = expected?.last where expected!.count == 2 && message ~= ~/expect {
-      completion = messagesSent.removeValueForKey(tag)?.completion
-    } else {
-      completion = nil
-      receiveNextMessage(tag: tag)
-    }
-    
-    MSLogDebug("response received '\(message)' with tag '\(tag)'")
-
-    if let response = Response(response: message) {
+    if let response = Response(data: data) {
       switch response {
-        case .UnknownCommand (let e):
-          completion?(false, Error.NetworkDeviceError.error(userInfo: [NSLocalizedFailureReasonErrorKey:e.reason]))
-        case .BusyIR(_, let t) where t == tag:
-          messagesSending[t] = entry
-          sendNextMessage()
-        case .StopIR(let t) where t == tag:
-          completion?(false, Error.CommandHalted.error())
+        case .CompleteIR(let port, let id):
+          if inFlightTags[port] == id {
+            if !continueStreamForPort(port) { completeEntryForPort(port, success: true, error: nil) }
+          }
+          else { MSLogWarn("ignoring completeir for port '\(port)' with unexpected ID '\(id)'") }
+        case .BusyIR(let port, let id):
+          if inFlightTags[port] == id { retryEntryForPort(port) }
+          else { MSLogWarn("ignoring busyIR for port '\(port)' with unexpected ID '\(id)'") }
+        case .StopIR(let port):
+          // Halting a stream is how it is meant to end. The stream may already have completed and the port moved on,
+          // in which case the reply has nothing left to stop.
+          if pendingStops.remove(port) == nil { MSLogWarn("ignoring unrequested stopir for port '\(port)'") }
+          else if isStreamingEntryForPort(port) { completeEntryForPort(port, success: true, error: nil) }
+        case .UnknownCommand(let e):
+          handleError(e)
         case .CapturedCommand(let c):
           learnerDelegate?.commandCaptured(c)
         case .LearnerEnabled:
           learnerDelegate?.learnerEnabled()
+          handleControlResponse(response)
         case .LearnerDisabled:
           learnerDelegate?.learnerDisabled()
+          handleControlResponse(response)
         case .LearnerUnavailable:
           learnerDelegate?.learnerUnavailable()
-        case .CompleteIR, .Device, .EndListDevices, .Version, .Network, .IRConfig:
-          completion?(true, nil)
+          handleControlResponse(response)
         default:
-          completion?(false, nil)
+          handleControlResponse(response)
       }
     } else {
-      completion?(false, nil)
+      MSLogWarn("unrecognized response '\(toString(NSString(data: data, encoding: NSUTF8StringEncoding)))'")
     }
-
   }
 
   /**
-  socket:didWriteDataWithTag:
+  connection:didWriteDataWithTag:
 
-  :param: sock GCDAsyncSocket
+  :param: connection NetworkDeviceConnection
   :param: tag Int
   */
-  func socket(sock: GCDAsyncSocket, didWriteDataWithTag tag: Int) {
+  func connection(connection: NetworkDeviceConnection, didWriteDataWithTag tag: Int) {
 
-    // Take the message sent out of our pending collection
-    if let entry = messagesSending.removeValueForKey(tag) {
-
-      MSLogDebug("entry written with message '\(entry.message)' and tag '\(tag)'")
-
-      // Insert it into our delivered collection
-      messagesSent[tag] = entry
-
-      // Send next if queue is not empty
-      sendNextMessage()
+    // Mark the message as delivered, restarting its clock
+    if let entry = messages.entryForTag(tag) where messages.stateForTag(tag) == .Sending {
+      messages.setState(.Sent, forTag: tag)
+      MSLogDebug("entry written for port '\(entry.messageData.port)' with tag '\(tag)'")
     }
 
   }
 
   /**
-  socketDidDisconnect:withError:
+  connectionDidDisconnect:withError:
 
-  :param: sock GCDAsyncSocket
+  :param: connection NetworkDeviceConnection
   :param: error NSError?
   */
-  func socketDidDisconnect(sock: GCDAsyncSocket, withError error: NSError?) {
+  func connectionDidDisconnect(connection: NetworkDeviceConnection, withError error: NSError?) {
     MSLogDebug("socket disconnected with error: \(toString(descriptionForError(error)))")
+    if connecting { connectCallback?(false, error); connectCallback = nil }
+    connected = false
+    connecting = false
+    streamingCommands.removeAll()
+    pendingStops.removeAll()
+    stopTimeoutTimer()
+    failInFlightEntries(error)
     disconnectCallback?(true, error)
     disconnectCallback = nil
   }
@@ -362,6 +660,19 @@ import MoonKit
     case ERR_26 = "ERR_26"
     case ERR_27 = "ERR_27"
 
+    static let allValues: [ITachError] = [.ERR_01, .ERR_02, .ERR_03, .ERR_04, .ERR_05, .ERR_06, .ERR_07, .ERR_08, .ERR_09,
+                                          .ERR_10, .ERR_11, .ERR_12, .ERR_13, .ERR_14, .ERR_15, .ERR_16, .ERR_17, .ERR_18,
+                                          .ERR_19, .ERR_20, .ERR_21, .ERR_22, .ERR_23, .ERR_24, .ERR_25, .ERR_26, .ERR_27]
+
+    /**
+    Initialize from the numeric portion of the error, i.e. `3` for `ERR_03`
+
+    :param: code Int
+    */
+    init?(code: Int) {
+      if 1 ... ITachError.allValues.count ~= code { self = ITachError.allValues[code - 1] } else { return nil }
+    }
+
     var reason: String {
       switch self {
         case .ERR_01: return "Invalid command. Command not found"
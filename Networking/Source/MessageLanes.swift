@@ -0,0 +1,129 @@
+//
+//  MessageLanes.swift
+//  Remote
+//
+//  Created by Jason Cardwell on 5/19/15.
+//  Copyright (c) 2015 Moondeer Studios. All rights reserved.
+//
+
+import Foundation
+import MoonKit
+
+/**
+Per-port message buffers split into priority lanes. For any port, the `Interactive` lane drains before the `Macro` lane
+and the `Macro` lane before the `Maintenance` lane. Each lane holds at most its bound of entries across all ports and
+refuses the rest. A maintenance message identical to one already waiting is coalesced into the waiting entry, whose
+completion then reports to every caller.
+*/
+struct MessageLanes<T:MessageData> {
+
+  typealias Entry = MessageQueueEntry<T>
+  typealias Lane = ConnectionManager.Priority
+  typealias Callback = ConnectionManager.Callback
+
+  enum EnqueueResult { case Enqueued, Coalesced, Refused }
+
+  /** Number of entries each lane may hold unless configured otherwise */
+  static var DefaultBounds: [Lane:Int] { return [.Interactive: 32, .Macro: 128, .Maintenance: 8] }
+
+  /** Maximum number of entries held by each lane, lanes without a bound are unbounded */
+  var bounds: [Lane:Int]
+
+  private var queues: [Lane:[Int:Queue<Entry>]] = [:]
+
+  private var counts: [Lane:Int] = [:]
+
+  /** Completions for maintenance messages coalesced into a waiting entry keyed by message */
+  private var coalescedCompletions: [String:[Callback]] = [:]
+
+  /**
+  initWithBounds:
+
+  :param: bounds [Lane:Int] = DefaultBounds
+  */
+  init(bounds: [Lane:Int] = MessageLanes.DefaultBounds) { self.bounds = bounds }
+
+  /** Whether every lane is empty */
+  var isEmpty: Bool { return reduce(counts.values, 0, +) == 0 }
+
+  /** Ports with at least one entry waiting, in ascending order */
+  var ports: [Int] {
+    var ports = Set<Int>()
+    for queues in self.queues.values { for (port, queue) in queues { if !queue.isEmpty { ports.insert(port) } } }
+    return sorted(ports)
+  }
+
+  /**
+  countForLane:
+
+  :param: lane Lane
+
+  :returns: Int
+  */
+  func countForLane(lane: Lane) -> Int { return counts[lane] ?? 0 }
+
+  /**
+  Highest priority lane among `lanes` holding an entry for `port`
+
+  :param: port Int
+  :param: lanes [Lane] = Lane.allValues
+
+  :returns: Lane?
+  */
+  func laneForPort(port: Int, lanes: [Lane] = Lane.allValues) -> Lane? {
+    for lane in lanes { if let queue = queues[lane]?[port] where !queue.isEmpty { return lane } }
+    return nil
+  }
+
+  /**
+  Appends the entry to the lane's queue for `port`
+
+  :param: entry Entry
+  :param: port Int
+  :param: lane Lane
+  :param: bounded Bool = true Whether the lane's bound applies, entries continuing work already admitted pass `false`
+
+  :returns: EnqueueResult
+  */
+  mutating func enqueue(entry: Entry, port: Int, lane: Lane, bounded: Bool = true) -> EnqueueResult {
+    if let completions = coalescedCompletions[entry.message] where lane == .Maintenance {
+      if let completion = entry.completion { coalescedCompletions[entry.message] = completions + [completion] }
+      return .Coalesced
+    }
+    if let bound = bounds[lane] where bounded && countForLane(lane) >= bound { return .Refused }
+
+    if queues[lane] == nil { queues[lane] = [:] }
+    if queues[lane]![port] == nil { queues[lane]![port] = Queue() }
+    queues[lane]![port]!.enqueue(entry)
+    counts[lane] = countForLane(lane) + 1
+    if lane == .Maintenance { coalescedCompletions[entry.message] = [] }
+    return .Enqueued
+  }
+
+  /**
+  Removes the next entry for `port` from the highest priority lane among `lanes` that holds one
+
+  :param: port Int
+  :param: lanes [Lane] = Lane.allValues
+
+  :returns: (Entry, Lane)?
+  */
+  mutating func dequeueForPort(port: Int, lanes: [Lane] = Lane.allValues) -> (Entry, Lane)? {
+    if let lane = laneForPort(port, lanes: lanes) {
+      var entry = queues[lane]![port]!.dequeue()!
+      counts[lane] = countForLane(lane) - 1
+      let completions = lane == .Maintenance ? coalescedCompletions.removeValueForKey(entry.message) ?? [] : []
+      if !completions.isEmpty {
+        let completion = entry.completion
+        entry = Entry(messageData: entry.messageData, userInfo: entry.userInfo) {
+          success, error in
+          completion?(success, error)
+          for coalesced in completions { coalesced(success, error) }
+        }
+      }
+      return (entry, lane)
+    }
+    return nil
+  }
+
+}
@@ -0,0 +1,184 @@
+//
+//  MessageTagTable.swift
+//  Remote
+//
+//  Created by Jason Cardwell on 5/12/15.
+//  Copyright (c) 2015 Moondeer Studios. All rights reserved.
+//
+
+import Foundation
+import MoonKit
+
+/**
+Fixed-capacity ring of in-flight messages indexed by tag. Tags are handed out sequentially and wrap at `MaxTag`, the
+slot for a tag is `tag % capacity`, so lookup, insertion and removal are all constant time. An entry still occupying a
+slot when its tag comes around again never received a response and is evicted as an orphan.
+*/
+struct MessageTagTable<T:MessageData> {
+
+  typealias Entry = MessageQueueEntry<T>
+
+  enum State { case Sending, Sent }
+
+  private struct Slot {
+    let tag: Int
+    var entry: Entry
+    var state: State
+    var timestamp: CFAbsoluteTime
+  }
+
+  /** Tags wrap to `0` upon reaching this value, `sendir` accepts IDs between 0 and 65535 */
+  static var MaxTag: Int { return 65536 }
+
+  let capacity: Int
+
+  private var slots: [Slot?]
+
+  private var nextTag = 0
+
+  /** Number of entries currently held */
+  private(set) var count = 0
+
+  var isEmpty: Bool { return count == 0 }
+
+  /**
+  initWithCapacity:
+
+  :param: capacity Int Must be a power of two no larger than `MaxTag`
+  */
+  init(capacity: Int = 64) {
+    assert(capacity > 0 && capacity & (capacity - 1) == 0 && capacity <= MessageTagTable.MaxTag,
+           "capacity must be a power of two no larger than \(MessageTagTable.MaxTag)")
+    self.capacity = capacity
+    slots = [Slot?](count: capacity, repeatedValue: nil)
+  }
+
+  /**
+  Stores the entry in the `Sending` state under the next tag
+
+  :param: entry Entry
+
+  :returns: (tag: Int, orphan: Entry?) The tag assigned and any entry evicted from the slot
+  */
+  mutating func insert(entry: Entry) -> (tag: Int, orphan: Entry?) {
+    let tag = nextTag
+    nextTag = (nextTag + 1) % MessageTagTable.MaxTag
+    let index = tag & (capacity - 1)
+    let orphan = slots[index]?.entry
+    if orphan == nil { count++ }
+    slots[index] = Slot(tag: tag, entry: entry, state: .Sending, timestamp: CFAbsoluteTimeGetCurrent())
+    return (tag, orphan)
+  }
+
+  /**
+  entryForTag:
+
+  :param: tag Int
+
+  :returns: Entry?
+  */
+  func entryForTag(tag: Int) -> Entry? { return slotForTag(tag)?.entry }
+
+  /**
+  stateForTag:
+
+  :param: tag Int
+
+  :returns: State?
+  */
+  func stateForTag(tag: Int) -> State? { return slotForTag(tag)?.state }
+
+  /**
+  Time at which the entry for `tag` last changed state
+
+  :param: tag Int
+
+  :returns: CFAbsoluteTime?
+  */
+  func timestampForTag(tag: Int) -> CFAbsoluteTime? { return slotForTag(tag)?.timestamp }
+
+  /**
+  Moves the entry for `tag` into the specified state, optionally replacing the entry, and restarts its clock
+
+  :param: state State
+  :param: tag Int
+  :param: entry Entry? = nil
+
+  :returns: Entry? The entry held for `tag` after the update
+  */
+  mutating func setState(state: State, forTag tag: Int, entry: Entry? = nil) -> Entry? {
+    let index = tag & (capacity - 1)
+    if var slot = slots[index] where slot.tag == tag {
+      slot.state = state
+      slot.timestamp = CFAbsoluteTimeGetCurrent()
+      if let entry = entry { slot.entry = entry }
+      slots[index] = slot
+      return slot.entry
+    }
+    return nil
+  }
+
+  /**
+  removeEntryForTag:
+
+  :param: tag Int
+
+  :returns: Entry?
+  */
+  mutating func removeEntryForTag(tag: Int) -> Entry? {
+    let index = tag & (capacity - 1)
+    if let slot = slots[index] where slot.tag == tag {
+      slots[index] = nil
+      count--
+      return slot.entry
+    }
+    return nil
+  }
+
+  /**
+  Removes every entry that has not changed state within `timeout` seconds
+
+  :param: timeout CFTimeInterval
+
+  :returns: [(Int, Entry)] The tags and entries removed
+  */
+  mutating func removeEntriesOlderThan(timeout: CFTimeInterval) -> [(Int, Entry)] {
+    var expired: [(Int, Entry)] = []
+    if count == 0 { return expired }
+    let deadline = CFAbsoluteTimeGetCurrent() - timeout
+    for index in 0 ..< capacity {
+      if let slot = slots[index] where slot.timestamp < deadline {
+        expired.append((slot.tag, slot.entry))
+        slots[index] = nil
+        count--
+      }
+    }
+    return expired
+  }
+
+  /**
+  Removes all entries
+
+  :returns: [(Int, Entry)] The tags and entries removed
+  */
+  mutating func removeAll() -> [(Int, Entry)] {
+    var removed: [(Int, Entry)] = []
+    for index in 0 ..< capacity { if let slot = slots[index] { removed.append((slot.tag, slot.entry)) } }
+    slots = [Slot?](count: capacity, repeatedValue: nil)
+    count = 0
+    return removed
+  }
+
+  /**
+  slotForTag:
+
+  :param: tag Int
+
+  :returns: Slot?
+  */
+  private func slotForTag(tag: Int) -> Slot? {
+    if tag < 0 { return nil }
+    if let slot = slots[tag & (capacity - 1)] where slot.tag == tag { return slot } else { return nil }
+  }
+
+}
@@ -11,15 +11,23 @@ import MoonKit
 
 
 
+/**
+Receives the beacons broadcast to a multicast group. Datagrams over a source's rate limit are dropped before they are
+read, the rest are parsed in place as `Beacon` values and only beacons whose identifier has not been delivered recently
+reach `callback`.
+*/
 @objc class MulticastConnection: GCDAsyncUdpSocketDelegate {
 
   let address: String
   let port: UInt16
-  let callback: ((String) -> Void)?
+  let callback: ((Beacon) -> Void)?
 
   private var listening = false
   private var joinedGroup = false
 
+  /** Accessed only on `queue` */
+  private var filter = BeaconFilter()
+
   private let socket: GCDAsyncUdpSocket
   private static let queue = dispatch_queue_create("com.moondeerstudios.networking.multicast", DISPATCH_QUEUE_SERIAL)
 
@@ -28,8 +36,9 @@ import MoonKit
 
   :param: a String
   :param: p UInt16
+  :param: callback ((Beacon) -> Void)? = nil
   */
-  init(address: String, port: UInt16, callback: ((String) -> Void)? = nil) {
+  init(address: String, port: UInt16, callback: ((Beacon) -> Void)? = nil) {
     self.address = address; self.port = port; self.callback = callback
     socket = GCDAsyncUdpSocket()
     socket.setDelegate(self)
@@ -80,6 +89,8 @@ import MoonKit
   func listen(error: NSErrorPointer = nil) -> Bool {
     if !joinedGroup { joinGroup(error) }
     if joinedGroup && !listening {
+      // Beacons seen before listening stopped are delivered again
+      dispatch_async(MulticastConnection.queue) { self.filter.reset() }
       listening = socket.beginReceiving(error)
     }
     return listening
@@ -101,7 +112,8 @@ import MoonKit
   func udpSocket(sock: GCDAsyncUdpSocket!, didReceiveData data: NSData!, fromAddress address: NSData!,
     withFilterContext filterContext: AnyObject!)
   {
-    if let string = NSString(data: data) as? String { callback?(string) }
+    if !filter.admitDatagramFromAddress(address) { return }
+    if let beacon = Beacon(data: data) where filter.admitBeacon(beacon) { callback?(beacon) }
   }
 
 }
\ No newline at end of file
@@ -8,206 +8,384 @@
 
 import Foundation
 import MoonKit
-import DataModel
 
-@objc class NetworkDeviceConnection {
+/** Receives the events of a `NetworkDeviceConnection`, always on the connection's `delegateQueue` */
+protocol NetworkDeviceConnectionDelegate: class {
 
-  typealias Error = ConnectionManager.Error
-
-  private var sourcesRegistered = 0
-  private var messageQueue = Queue<MessageQueueEntry>()
-  private let dataCallback: ((String) -> Void)?
-  private var connectCallback: ConnectionManager.Callback?
-  private var disconnectCallback: ConnectionManager.Callback?
+  /**
+  Invoked once the socket has connected and the channel is open
 
-  private(set) var readSource: dispatch_source_t?
-  private(set) var writeSource: dispatch_source_t?
-  private(set) var connecting = false
+  :param: connection NetworkDeviceConnection
+  */
+  func connectionDidConnect(connection: NetworkDeviceConnection)
 
-  var connected: Bool {
-    return    readSource != nil  && dispatch_source_testcancel(readSource!) == 0
-           && writeSource != nil && dispatch_source_testcancel(writeSource!) == 0
-  }
+  /**
+  Invoked for each delimited frame received. The frame includes its delimiter and only references the connection's
+  receive buffer, it must be copied if it is needed once this method returns.
 
+  :param: connection NetworkDeviceConnection
+  :param: frame NSData
+  */
+  func connection(connection: NetworkDeviceConnection, didReceiveFrame frame: NSData)
 
   /**
-  init:
+  Invoked once all of the data passed to `writeData:tag:` has been written
 
-  :param: c ((String) -> Void
+  :param: connection NetworkDeviceConnection
+  :param: tag Int
   */
-  init(callback: ((String) -> Void)? = nil) { dataCallback = callback }
+  func connection(connection: NetworkDeviceConnection, didWriteDataWithTag tag: Int)
 
   /**
-  Method for establishing a connection to `device` with an optional callback
+  Invoked when the channel closes, or when connecting fails
 
-  :param: completion ((Bool, NSError?) -> Void)? = nil
+  :param: connection NetworkDeviceConnection
+  :param: error NSError?
   */
-  func connect(completion: ((Bool, NSError?) -> Void)? = nil) {
+  func connectionDidDisconnect(connection: NetworkDeviceConnection, withError error: NSError?)
 
-    // Exit early if an attempt to connect is already in progress
-    if connecting {
-      MSLogWarn("already trying to establish a connection with device")
-      completion?(false, Error.ConnectionInProgress.error())
-    }
+}
 
-    // Or if we are already connected
-    else if connected {
-      MSLogWarn("already connected to device")
-      completion?(false, Error.ConnectionExists.error())
-    }
+/**
+Stream socket transport built on a `dispatch_io` channel. Bytes read from the channel are split into frames on
+`delimiter` inside a receive buffer drawn from a shared pool, so reading allocates nothing per event and buffers are
+reused across connections. Frames that arrive whole are handed to the delegate straight from the channel's data.
+Writes go out in order through the channel and are reported by tag.
+*/
+final class NetworkDeviceConnection {
 
-    // Otherwise set the flag and continue
-    else {
-      connecting = true
-      connectCallback = completion
+  enum State { case Disconnected, Connecting, Connected, Disconnecting }
 
+  static let CR = UInt8(ascii: "\r")
+  static let LF = UInt8(ascii: "\n")
 
-      // Get file descriptors and queues for sources
-      let sourceDescriptor = sourceFileDescriptor
+  /** Size of each receive buffer, a partial frame that outgrows it is discarded up to its delimiter */
+  static let ReceiveBufferCapacity = 4096
 
-      if sourceDescriptor >= 0 {
+  /** Most receive buffers kept for reuse */
+  static let MaxPooledBuffers = 8
 
-        if let readQueue = NetworkDeviceConnection.readSourceQueue {
+  /** Seconds allowed for connecting to each address resolved for a host, rather than the system's 75 */
+  static let ConnectTimeout: Int32 = 5
 
-          readSource = dispatch_source_create(DISPATCH_SOURCE_TYPE_READ,  UInt(sourceFileDescriptor), 0, readQueue)
-          assert(readSource != nil)
+  /** Performs the blocking name resolution and connect */
+  private static let connectQueue = dispatch_queue_create("com.moondeerstudios.networking.connect",
+                                                          DISPATCH_QUEUE_CONCURRENT)
 
-          dispatch_source_set_event_handler(readSource!, readEventHandler)
-          dispatch_source_set_cancel_handler(readSource!, readCancelHandler)
-          dispatch_source_set_registration_handler(readSource!, readRegistrationHandler)
-          dispatch_resume(readSource!)
+  private static var bufferPool: [NSMutableData] = []
+  private static let bufferPoolQueue = dispatch_queue_create("com.moondeerstudios.networking.buffers",
+                                                             DISPATCH_QUEUE_SERIAL)
 
-        }
+  /** Takes a receive buffer from the pool, creating one when the pool is empty */
+  private static func dequeueBuffer() -> NSMutableData {
+    var buffer: NSMutableData?
+    dispatch_sync(bufferPoolQueue) { if !self.bufferPool.isEmpty { buffer = self.bufferPool.removeLast() } }
+    return buffer ?? NSMutableData(length: ReceiveBufferCapacity)!
+  }
 
-        if let writeQueue = NetworkDeviceConnection.writeSourceQueue {
+  /**
+  Returns a receive buffer to the pool
 
-          writeSource = dispatch_source_create(DISPATCH_SOURCE_TYPE_READ,  UInt(sourceFileDescriptor), 0, writeQueue)
-          assert(writeSource != nil)
+  :param: buffer NSMutableData
+  */
+  private static func enqueueBuffer(buffer: NSMutableData) {
+    dispatch_async(bufferPoolQueue) { if self.bufferPool.count < self.MaxPooledBuffers { self.bufferPool.append(buffer) } }
+  }
 
-          dispatch_source_set_event_handler(writeSource!, writeEventHandler)
-          dispatch_source_set_cancel_handler(writeSource!, writeCancelHandler)
-          dispatch_source_set_registration_handler(writeSource!, writeRegistrationHandler)
-          dispatch_resume(writeSource!)
-        }
-        
-      }
-    }
+  weak var delegate: NetworkDeviceConnectionDelegate?
+
+  /** Serial queue on which the channel's handlers and all delegate methods run */
+  let delegateQueue: dispatch_queue_t
+
+  /** Byte that terminates each frame, a line feed following it is dropped from the next frame */
+  let delimiter: UInt8
 
+  private(set) var state = State.Disconnected
+
+  var connected: Bool { return state == .Connected }
+  var connecting: Bool { return state == .Connecting }
+
+  private var channel: dispatch_io_t?
+  private var receiveBuffer: NSMutableData?
+  private var receiveLength = 0
+  private var pendingWrites = 0
+  private var closeError: NSError?
+
+  /** Whether the bytes read are the rest of a frame that outgrew the receive buffer */
+  private var discardingFrame = false
+
+  /** Identifies the latest connect attempt so that one cancelled by `disconnect` is ignored when it finishes */
+  private var connectAttempt = 0
+
+  /**
+  initWithDelegateQueue:delimiter:
+
+  :param: delegateQueue dispatch_queue_t Must be serial
+  :param: delimiter UInt8 = CR
+  */
+  init(delegateQueue: dispatch_queue_t, delimiter: UInt8 = NetworkDeviceConnection.CR) {
+    self.delegateQueue = delegateQueue
+    self.delimiter = delimiter
   }
 
-  var sourceFileDescriptor: dispatch_fd_t { return -1 }
-
-  static let readSourceQueue  = dispatch_queue_create("com.moondeerstudios.receive", DISPATCH_QUEUE_CONCURRENT)
-  static let writeSourceQueue = dispatch_queue_create("com.moondeerstudios.send", DISPATCH_QUEUE_CONCURRENT)
-
-
-  var readEventHandler: dispatch_block_t {
-    return { [unowned self] in
-      if self.readSource == nil { return }
-      let bytesAvailable = dispatch_source_get_data(self.readSource!)
-      MSLogDebug("bytes available = \(bytesAvailable)")
-      var msg = UnsafeMutablePointer<Int8>.alloc(Int(bytesAvailable) + 1)
-      let handle = Int32(dispatch_source_get_handle(self.readSource!))
-      MSLogDebug("sourceFileDescriptor = \(self.sourceFileDescriptor), handle = \(handle), msg = \(msg)")
-      let bytesRead = read(handle, msg, Int(bytesAvailable))
-      MSLogDebug("bytesRead = \(bytesRead)")
-      if bytesRead < 0 {
-        MSLogError("read failed for socket: \(errno) - \(toString(String.fromCString(strerror(errno))))")
-        dispatch_source_cancel(self.readSource!)
-      } else if let message = String(CString: msg, encoding: NSUTF8StringEncoding) {
-        NSOperationQueue.mainQueue().addOperationWithBlock { self.dataCallback?(message) }
+  // MARK: - Connecting
+
+  /**
+  Resolves `host` and connects to it in the background, the delegate hears `connectionDidConnect:` on success and
+  `connectionDidDisconnect:withError:` on failure
+
+  :param: host String
+  :param: port UInt16
+
+  :returns: Bool `false` if the connection is not currently disconnected
+  */
+  func connectToHost(host: String, port: UInt16) -> Bool {
+    if state != .Disconnected { return false }
+    state = .Connecting
+    let attempt = ++connectAttempt
+    dispatch_async(NetworkDeviceConnection.connectQueue) {
+      var error: NSError?
+      let fd = NetworkDeviceConnection.socketConnectedToHost(host, port: port, error: &error)
+      dispatch_async(self.delegateQueue) {
+        if attempt != self.connectAttempt || self.state != .Connecting {
+          if fd >= 0 { close(fd) } // Disconnected while connecting, the delegate has already been told
+        } else if fd < 0 {
+          self.state = .Disconnected
+          self.delegate?.connectionDidDisconnect(self, withError: error)
+        } else {
+          self.openChannelWithSocket(fd)
+        }
       }
     }
+    return true
   }
 
-  var writeEventHandler: dispatch_block_t {
-    return { [unowned self] in
+  /**
+  Creates a TCP socket and connects it to the first address resolved for `host`, giving each address `ConnectTimeout`
+  seconds to accept the connection
 
-      if let entry = self.messageQueue.dequeue() where !entry.message.isEmpty {
-        assert(self.writeSource != nil)
-        var success = true
-        var error: NSError?
+  :param: host String
+  :param: port UInt16
+  :param: error NSErrorPointer
 
-        entry.message.withCString({
-          (msg: UnsafePointer<Int8>) -> Void in
+  :returns: dispatch_fd_t The connected socket or `-1`
+  */
+  private static func socketConnectedToHost(host: String, port: UInt16, error: NSErrorPointer) -> dispatch_fd_t {
+    var hints = addrinfo()
+    hints.ai_family = AF_UNSPEC
+    hints.ai_socktype = SOCK_STREAM
+    hints.ai_protocol = IPPROTO_TCP
+    var addresses = UnsafeMutablePointer<addrinfo>()
+
+    let status = getaddrinfo(host, toString(port), &hints, &addresses)
+    if status != 0 {
+      let reason = toString(String.fromCString(gai_strerror(status)))
+      MSLogError("error getting address info for \(host), \(port): \(reason)")
+      error.memory = NSError(domain: NSPOSIXErrorDomain, code: Int(status), userInfo: [NSLocalizedFailureReasonErrorKey: reason])
+      return -1
+    }
 
-          let bytesWritten = write(Int32(dispatch_source_get_handle(self.writeSource!)), msg, count(entry.message.utf8))
+    var fd: dispatch_fd_t = -1
+    var errorCode: Int32 = 0
+    for var address = addresses; address != nil; address = address.memory.ai_next {
+      fd = socket(address.memory.ai_family, address.memory.ai_socktype, address.memory.ai_protocol)
+      if fd < 0 { errorCode = errno; continue }
+      var timeout = ConnectTimeout
+      setsockopt(fd, IPPROTO_TCP, TCP_CONNECTIONTIMEOUT, &timeout, socklen_t(sizeof(Int32)))
+      if Darwin.connect(fd, address.memory.ai_addr, address.memory.ai_addrlen) == 0 { break }
+      errorCode = errno
+      close(fd)
+      fd = -1
+    }
+    freeaddrinfo(addresses)
 
-          // Check if string was written
-          if bytesWritten < 0 {
-            MSLogError("write failed for socket: \(errno) - \(toString(String.fromCString(strerror(errno))))")
-            success = false
-            error = NSError(domain: NSPOSIXErrorDomain, code: Int(errno), userInfo: nil)
+    if fd < 0 {
+      MSLogError("failed to connect to \(host), \(port): \(errorCode) - \(toString(String.fromCString(strerror(errorCode))))")
+      error.memory = NSError(domain: NSPOSIXErrorDomain, code: Int(errorCode), userInfo: nil)
+      return -1
+    }
 
-            dispatch_source_cancel(self.writeSource!)
-          }
-        })
+    // Device messages are small and latency sensitive
+    var on: Int32 = 1
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, socklen_t(sizeof(Int32)))
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, socklen_t(sizeof(Int32)))
+    return fd
+  }
 
-        entry.completion?(success, nil, error)
-      }
+  /**
+  Wraps the connected socket in a stream channel and starts reading, must be invoked on `delegateQueue`
 
+  :param: fd dispatch_fd_t
+  */
+  func openChannelWithSocket(fd: dispatch_fd_t) {
+    let channel = dispatch_io_create(dispatch_io_type_t(DISPATCH_IO_STREAM), fd, delegateQueue) {
+      _ in
+      close(fd)
+      self.channelDidClose()
+    }
+    dispatch_io_set_low_water(channel, 1)
+    self.channel = channel
+    receiveBuffer = NetworkDeviceConnection.dequeueBuffer()
+    receiveLength = 0
+    discardingFrame = false
+    pendingWrites = 0
+    closeError = nil
+    state = .Connected
+    delegate?.connectionDidConnect(self)
+
+    dispatch_io_read(channel, 0, Int.max, delegateQueue) {
+      done, data, errorCode in
+      if data != nil {
+        dispatch_data_apply(data) {
+          _, _, bytes, size in self.receiveBytes(UnsafePointer<UInt8>(bytes), length: size); return true
+        }
+      }
+      if done {
+        // Reaching the end of the stream means the device hung up
+        let error: NSError? = errorCode == 0 || errorCode == ECANCELED
+                                ? nil
+                                : NSError(domain: NSPOSIXErrorDomain, code: Int(errorCode), userInfo: nil)
+        self.closeWithError(error)
+      }
     }
   }
 
-  /** Should only be called from cancel handlers */
-  private func disconnectHandlerCallback() {
-    var error: NSError? = errno != 0 ? NSError(domain: NSPOSIXErrorDomain, code: Int(errno), userInfo: nil) : nil
-    self.disconnectCallback?(true, error)
-  }
+  /**
+  Closes the channel once the writes already issued have finished. A connect still in progress is abandoned and the
+  delegate hears `connectionDidDisconnect:withError:` with an `ECANCELED` error before this method returns. Must be
+  invoked on `delegateQueue`.
 
-  var readCancelHandler: dispatch_block_t {
-    return { [unowned self] in
-      assert(self.readSource != nil)
-      NSOperationQueue.mainQueue().addOperationWithBlock { [unowned self] in
-        self.sourcesRegistered--
-        close(Int32(dispatch_source_get_handle(self.readSource!)))
-        self.readSource = nil
-        if let w = self.writeSource where dispatch_source_testcancel(w) == 0 { dispatch_source_cancel(w) }
-        else { self.disconnectHandlerCallback() }
-      }
+  :returns: Bool `false` if there is neither an open channel nor a connect in progress
+  */
+  func disconnect() -> Bool {
+    switch state {
+      case .Connecting:
+        state = .Disconnected
+        connectAttempt++
+        delegate?.connectionDidDisconnect(self, withError: NSError(domain: NSPOSIXErrorDomain,
+                                                                   code: Int(ECANCELED),
+                                                                   userInfo: nil))
+        return true
+      case .Connected:
+        state = .Disconnecting
+        if pendingWrites == 0 { closeWithError(nil) }
+        return true
+      default:
+        return false
     }
   }
 
-  var writeCancelHandler: dispatch_block_t {
-    return { [unowned self] in
-      assert(self.writeSource != nil)
-      NSOperationQueue.mainQueue().addOperationWithBlock { [unowned self] in
-        self.sourcesRegistered--
-        close(Int32(dispatch_source_get_handle(self.writeSource!)))
-        self.writeSource = nil
-        if let r = self.readSource where dispatch_source_testcancel(r) == 0 { dispatch_source_cancel(r) }
-        else { self.disconnectHandlerCallback() }
-      }
+  /**
+  Stops the channel immediately, `error` is reported to the delegate once the channel has closed
+
+  :param: error NSError?
+  */
+  private func closeWithError(error: NSError?) {
+    if closeError == nil { closeError = error }
+    if let channel = channel {
+      self.channel = nil
+      state = .Disconnecting
+      dispatch_io_close(channel, dispatch_io_close_flags_t(DISPATCH_IO_STOP))
     }
   }
 
-  /** Should only be called from registration handlers to invoke connection callbacks if appropriate */
-  private func registrationHandlerCallback() {
-    if sourcesRegistered == 2 {
-      connecting = false
-      NSOperationQueue.mainQueue().addOperationWithBlock { [unowned self] in
-        self.connectCallback?(true, nil)
+  /** Invoked by the channel's cleanup handler after the socket has been closed */
+  private func channelDidClose() {
+    if let buffer = receiveBuffer { NetworkDeviceConnection.enqueueBuffer(buffer); receiveBuffer = nil }
+    receiveLength = 0
+    discardingFrame = false
+    state = .Disconnected
+    let error = closeError
+    closeError = nil
+    delegate?.connectionDidDisconnect(self, withError: error)
+  }
+
+  // MARK: - Reading
+
+  /**
+  Splits the bytes read into frames, buffering any partial frame until the rest arrives. Once a partial frame has
+  outgrown the receive buffer everything up to and including its delimiter is dropped. Must be invoked on
+  `delegateQueue` while the channel is open.
+
+  :param: bytes UnsafePointer<UInt8>
+  :param: length Int
+  */
+  func receiveBytes(bytes: UnsafePointer<UInt8>, length: Int) {
+    var start = 0
+    for i in 0 ..< length {
+      if bytes[i] != delimiter { continue }
+      if discardingFrame {
+        discardingFrame = false
+      } else if receiveLength == 0 {
+        deliverFrame(bytes + start, length: i + 1 - start)
+      } else if appendBytes(bytes + start, length: i + 1 - start) {
+        deliverFrame(UnsafePointer<UInt8>(receiveBuffer!.bytes), length: receiveLength)
+        receiveLength = 0
       }
+      start = i + 1
     }
+    if start < length && !discardingFrame { discardingFrame = !appendBytes(bytes + start, length: length - start) }
   }
 
-  var readRegistrationHandler: dispatch_block_t {
-    return { [unowned self] in self.sourcesRegistered++; self.registrationHandlerCallback() }
+  /**
+  Appends bytes to the partial frame held in the receive buffer
+
+  :param: bytes UnsafePointer<UInt8>
+  :param: length Int
+
+  :returns: Bool `false` if the frame no longer fits and was discarded
+  */
+  private func appendBytes(bytes: UnsafePointer<UInt8>, length: Int) -> Bool {
+    if let buffer = receiveBuffer where receiveLength + length <= buffer.length {
+      memcpy(buffer.mutableBytes + receiveLength, bytes, length)
+      receiveLength += length
+      return true
+    }
+    MSLogWarn("discarding frame longer than \(NetworkDeviceConnection.ReceiveBufferCapacity) bytes")
+    receiveLength = 0
+    return false
   }
 
-  var writeRegistrationHandler: dispatch_block_t {
-    return { [unowned self] in self.sourcesRegistered++; self.registrationHandlerCallback() }
+  /**
+  Hands a frame to the delegate without copying it
+
+  :param: bytes UnsafePointer<UInt8>
+  :param: length Int
+  */
+  private func deliverFrame(var bytes: UnsafePointer<UInt8>, var length: Int) {
+    if length > 0 && bytes[0] == NetworkDeviceConnection.LF { bytes++; length-- }
+    if length == 0 || (length == 1 && bytes[0] == delimiter) { return }
+    let frame = NSData(bytesNoCopy: UnsafeMutablePointer<Void>(bytes), length: length, freeWhenDone: false)
+    delegate?.connection(self, didReceiveFrame: frame)
   }
 
+  // MARK: - Writing
+
   /**
-  Method for disconnecting from the device with an optional callback
+  Writes `data` after any writes already issued, must be invoked on `delegateQueue`
+
+  :param: data NSData
+  :param: tag Int Passed back through `connection:didWriteDataWithTag:`
 
-  :param: completion ((Bool, NSError?) -> Void)? = nil
+  :returns: Bool `false` if there is no open channel
   */
-  func disconnect(completion: ((Bool, NSError?) -> Void)? = nil) {
-    disconnectCallback = completion
-    if let r = self.readSource where dispatch_source_testcancel(r) == 0 { dispatch_source_cancel(r) }
-    if let w = self.writeSource where dispatch_source_testcancel(w) == 0 { dispatch_source_cancel(w) }
+  func writeData(data: NSData, tag: Int) -> Bool {
+    if state != .Connected || channel == nil { return false }
+    let dispatchData = dispatch_data_create(data.bytes, data.length, delegateQueue) { withExtendedLifetime(data) {} }
+    pendingWrites++
+    dispatch_io_write(channel!, 0, dispatchData, delegateQueue) {
+      done, _, errorCode in
+      if !done { return }
+      self.pendingWrites--
+      if errorCode == 0 {
+        self.delegate?.connection(self, didWriteDataWithTag: tag)
+        if self.state == .Disconnecting && self.pendingWrites == 0 { self.closeWithError(nil) }
+      } else if errorCode != ECANCELED {
+        MSLogError("write failed for socket: \(errorCode) - \(toString(String.fromCString(strerror(errorCode))))")
+        self.closeWithError(NSError(domain: NSPOSIXErrorDomain, code: Int(errorCode), userInfo: nil))
+      }
+    }
+    return true
   }
 
-}
\ No newline at end of file
+}
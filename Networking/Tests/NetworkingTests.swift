@@ -8,6 +8,9 @@
 
 import UIKit
 import XCTest
+import CoreData
+import MoonKit
+import DataModel
 
 class NetworkingTests: XCTestCase {
     
@@ -33,4 +36,417 @@ class NetworkingTests: XCTestCase {
         }
     }
     
+
+  // MARK: - ISY node synchronization
+
+  /**
+  A context whose saves go no further than an isolated parent that is never saved
+
+  :returns: NSManagedObjectContext
+  */
+  private func scratchContext() -> NSManagedObjectContext {
+    let context = NSManagedObjectContext(concurrencyType: .PrivateQueueConcurrencyType)
+    context.parentContext = DataManager.isolatedContext()
+    return context
+  }
+
+  /**
+  countOfEntity:forDevice:
+
+  :param: entityName String
+  :param: device ISYDevice
+
+  :returns: Int
+  */
+  private func countOfEntity(entityName: String, forDevice device: ISYDevice) -> Int {
+    let request = NSFetchRequest(entityName: entityName)
+    request.predicate = NSPredicate(format: "device == %@", device)
+    return device.managedObjectContext?.countForFetchRequest(request, error: nil) ?? 0
+  }
+
+  func testSynchronizeNodesDeletesDuplicates() {
+    let moc = scratchContext()
+    moc.performBlockAndWait {
+      let device = ISYDevice(context: moc)
+      device.name = "ISY"
+      device.uniqueIdentifier = "uuid:00:21:b9:01:f2:c5"
+      device.baseURL = "http://192.168.1.9"
+      device.deviceType = "urn:udi-com:device:X_Insteon_Lighting_Device:1"
+      device.friendlyName = "ISY994i"
+      device.manufacturer = "Universal Devices Inc."
+      device.manufacturerURL = "http://www.universal-devices.com"
+      device.modelDescription = "X_Insteon_Lighting_Device"
+      device.modelName = "Insteon_Device"
+      device.modelNumber = "1.0"
+
+      // Copies of the same node and group as left by imports that reinserted everything
+      for _ in 0 ..< 3 {
+        let node = ISYDeviceNode(context: moc)
+        node.address = "1B 6E B2 1"
+        node.device = device
+        let group = ISYDeviceGroup(context: moc)
+        group.address = "00:21:b9:01:f2:c5:01"
+        group.device = device
+      }
+
+      var node = ISYDeviceConnection.NodeRecord()
+      node.address = "1B 6E B2 1"
+      node.name = "Front Door Table Lamp"
+      node.type = "1.32.65.0"
+      node.pnode = node.address
+      node.enabled = true
+      node.propertyID = "ST"
+      node.propertyUOM = "%/on/off"
+      node.propertyFormatted = "Off"
+
+      var group = ISYDeviceConnection.GroupRecord()
+      group.address = "00:21:b9:01:f2:c5:01"
+      group.name = "Living Room"
+      group.members = [node.address]
+
+      for _ in 0 ..< 2 {
+        XCTAssert(ISYDeviceConnection.synchronizeNodes([node], groups: [group], forDevice: device, context: moc))
+        XCTAssertEqual(self.countOfEntity("ISYDeviceNode", forDevice: device), 1)
+        XCTAssertEqual(self.countOfEntity("ISYDeviceGroup", forDevice: device), 1)
+        XCTAssertFalse(moc.hasChanges)
+      }
+      XCTAssertEqual(device.nodes.count, 1)
+      XCTAssertEqual(device.groups.count, 1)
+      XCTAssertEqual(device.groups.first?.members.count ?? 0, 1)
+    }
+  }
+
+  func testDecodeNodes() {
+    let url = NSBundle(forClass: NetworkingTests.self).URLForResource("nodes", withExtension: "xml")
+    let data = url != nil ? NSData(contentsOfURL: url!) : nil
+    XCTAssert(data != nil, "missing nodes.xml fixture")
+    if data == nil { return }
+
+    let decoded = ISYDeviceConnection.NodesDecoder.decode(data!)
+    XCTAssert(decoded != nil)
+    if decoded == nil { return }
+    let (nodes, groups) = decoded!
+
+    XCTAssertEqual(nodes.count, 4)
+    XCTAssertEqual(nodes.map {$0.address}, ["18 F0 8 1", "1B 6E B2 1", "20 12 40 1", "23 78 77 1"])
+    if nodes.count == 4 {
+      XCTAssertEqual(nodes[1].name, "1B.6E.B2.1")
+      XCTAssertEqual(nodes[1].type, "2.23.57.0")
+      XCTAssertEqual(nodes[1].pnode, "1B 6E B2 1")
+      XCTAssertEqual(nodes[1].flag, Int16(128))
+      XCTAssert(nodes[1].enabled)
+      XCTAssertFalse(nodes[0].enabled)
+      XCTAssertEqual(nodes[1].propertyID, "ST")
+      XCTAssertEqual(nodes[1].propertyValue, Int16(255))
+      XCTAssertEqual(nodes[1].propertyUOM, "on/off")
+      XCTAssertEqual(nodes[1].propertyFormatted, "On")
+    }
+
+    XCTAssertEqual(groups.count, 2)
+    if groups.count == 2 {
+      XCTAssertEqual(groups[0].address, "00:21:b9:01:f2:b6")
+      XCTAssertEqual(groups[0].name, "ISY")
+      XCTAssertEqual(groups[0].flag, Int16(12))
+      XCTAssertEqual(groups[0].family, Int16(6))
+      XCTAssertEqual(groups[0].members, nodes.map {$0.address})
+      XCTAssertEqual(groups[1].address, "ADR0001")
+      XCTAssertEqual(groups[1].name, "Auto DR")
+      XCTAssertEqual(groups[1].family, Int16(5))
+      XCTAssert(groups[1].members.isEmpty)
+    }
+  }
+
+  // MARK: - iTach responses
+
+  typealias Response = ITachDeviceConnection.Response
+
+  /** Responses seen during IR traffic, in the proportions of a busy macro */
+  private let trafficResponses = ["completeir,1:1,4021\r", "completeir,1:3,4022\r", "busyIR,1:2,4023\r",
+                                  "stopir,1:1\r", "unknowncommand,ERR_03\r", "completeir,1:2,4024\r"]
+
+  func testResponseClassification() {
+    switch Response(response: "completeir,1:2,4021\r") {
+      case let .Some(.CompleteIR(port, id)): XCTAssertEqual(port, 2); XCTAssertEqual(id, 4021)
+      default: XCTFail("completeir not classified")
+    }
+    switch Response(response: "busyIR,1:3,17") {
+      case let .Some(.BusyIR(port, id)): XCTAssertEqual(port, 3); XCTAssertEqual(id, 17)
+      default: XCTFail("busyIR not classified")
+    }
+    switch Response(response: "stopir,1:1\r") {
+      case let .Some(.StopIR(port)): XCTAssertEqual(port, 1)
+      default: XCTFail("stopir not classified")
+    }
+    switch Response(response: "unknowncommand,ERR_03\r") {
+      case let .Some(.UnknownCommand(error)): XCTAssert(error == .ERR_03)
+      default: XCTFail("unknowncommand not classified")
+    }
+    switch Response(response: "device,1,3 IR\r") {
+      case let .Some(.Device(module, port, type)):
+        XCTAssertEqual(module, 1); XCTAssertEqual(port, 3); XCTAssert(type == .ThreeIR)
+      default: XCTFail("device not classified")
+    }
+    switch Response(response: "IR Learner Enabled\r") {
+      case .Some(.LearnerEnabled): break
+      default: XCTFail("learner response not classified")
+    }
+  }
+
+  func testMalformedResponsesAreRejected() {
+    XCTAssert(Response(response: "completeir,1:4,4021\r") == nil, "port out of range")
+    XCTAssert(Response(response: "completeir,1:1,4021x\r") == nil, "trailing bytes")
+    XCTAssert(Response(response: "completeir,1:1,\r") == nil, "missing id")
+    XCTAssert(Response(response: "completeir,1:1,99999999999999999999999999999999\r") == nil, "id overflows")
+    XCTAssert(Response(response: "unknowncommand,ERR_99\r") == nil, "unknown error code")
+    XCTAssert(Response(response: "garbage\r") == nil)
+  }
+
+  func testResponseClassificationPerformance() {
+    let data = compressedMap(trafficResponses, {$0.dataUsingEncoding(NSUTF8StringEncoding)})
+    measureBlock {
+      for _ in 0 ..< 10_000 { for response in data { _ = Response(data: response) } }
+    }
+  }
+
+  /** Baseline for `testResponseClassificationPerformance`, the regular expression matching the scanner replaced */
+  func testRegularExpressionResponseMatchingPerformance() {
+    let patterns = ["^(?:complete|busy)ir,1:[1-3],\\d+\\r$", "^stopir,1:[1-3]\\r$", "^unknowncommand,ERR_\\d+\\r$",
+                    "^device[^\\r]+\\r$", "endlistdevices\\r$", "^NET[^\\r]+\\r$"]
+    measureBlock {
+      for _ in 0 ..< 10_000 {
+        for response in self.trafficResponses {
+          _ = findFirst(patterns, {response.rangeOfString($0, options: .RegularExpressionSearch) != nil})
+        }
+      }
+    }
+  }
+
+  // MARK: - Beacons
+
+  /**
+  beaconWithString:
+
+  :param: string String
+
+  :returns: Beacon?
+  */
+  private func beaconWithString(string: String) -> Beacon? {
+    return Beacon(data: string.dataUsingEncoding(NSUTF8StringEncoding)!)
+  }
+
+  /**
+  SSDP announcement from the ISY for the specified service type
+
+  :param: service String
+  :param: location Bool = true Whether the announcement carries a `LOCATION` header
+
+  :returns: String
+  */
+  private func ssdpAnnouncement(service: String, location: Bool = true) -> String {
+    return "NOTIFY * HTTP/1.1\r\nHOST: 239.255.255.250:1900\r\n"
+         + (location ? "LOCATION: http://192.168.1.9/desc\r\n" : "")
+         + "NT: \(service)\r\nUSN: uuid:00:21:b9:01:f2:b6::\(service)\r\nNTS: ssdp:alive\r\n\r\n"
+  }
+
+  func testAMXBBeaconParsing() {
+    let beacon = beaconWithString("AMXB<-UUID=GlobalCache_000C1E024239><-SDKClass=Utility><-Make=GlobalCache>"
+                                + "<-Model=iTachIP2IR><-Revision=710-1005-05><-Config-URL=http://192.168.1.10>\r")
+    XCTAssert(beacon?.kind == .AMXB)
+    XCTAssertEqual(beacon?.identifier ?? "", "GlobalCache_000C1E024239")
+    XCTAssert(beacon?.location == nil)
+    XCTAssert(beaconWithString("AMXB<-SDKClass=Utility>\r") == nil, "no UUID")
+  }
+
+  func testSSDPBeaconParsing() {
+    let beacon = beaconWithString(ssdpAnnouncement("urn:udi-com:device:X_Insteon_Lighting_Device:1"))
+    XCTAssert(beacon?.kind == .SSDP)
+    XCTAssertEqual(beacon?.identifier ?? "", "uuid:00:21:b9:01:f2:b6")
+    XCTAssertEqual(beacon?.location ?? "", "http://192.168.1.9/desc")
+
+    let service = beaconWithString(ssdpAnnouncement("urn:udi-com:service:X_Insteon_Lighting_Service:1"))
+    XCTAssertEqual(service?.identifier ?? "", "uuid:00:21:b9:01:f2:b6", "services share the device's uuid")
+    XCTAssertEqual(service?.identifierHash ?? 0, beacon?.identifierHash ?? 1)
+
+    let unlocated = beaconWithString(ssdpAnnouncement("upnp:rootdevice", location: false))
+    XCTAssertEqual(unlocated?.identifier ?? "", "uuid:00:21:b9:01:f2:b6")
+    XCTAssert(unlocated != nil && unlocated!.location == nil)
+
+    let located = beaconWithString("NOTIFY * HTTP/1.1\r\nLOCATION: http://192.168.1.9/desc\r\n\r\n")
+    XCTAssertEqual(located?.identifier ?? "", "http://192.168.1.9/desc", "LOCATION stands in for a missing USN")
+
+    XCTAssert(beaconWithString("NOTIFY * HTTP/1.1\r\nNTS: ssdp:alive\r\n\r\n") == nil, "no USN or LOCATION")
+  }
+
+  func testBeaconFilterDropsDuplicatesWithinInterval() {
+    var filter = BeaconFilter()
+    let device = beaconWithString(ssdpAnnouncement("upnp:rootdevice"))!
+    let service = beaconWithString(ssdpAnnouncement("urn:udi-com:service:X_Insteon_Lighting_Service:1"))!
+    let other = beaconWithString("AMXB<-UUID=GlobalCache_000C1E024239>\r")!
+
+    XCTAssert(filter.admitBeacon(device, now: 0))
+    XCTAssertFalse(filter.admitBeacon(device, now: 30))
+    XCTAssertFalse(filter.admitBeacon(service, now: 59.9), "a service of a delivered device is a duplicate")
+    XCTAssert(filter.admitBeacon(other, now: 30))
+    XCTAssert(filter.admitBeacon(device, now: 60))
+    XCTAssertFalse(filter.admitBeacon(device, now: 61))
+
+    filter.reset()
+    XCTAssert(filter.admitBeacon(device, now: 62))
+  }
+
+  func testBeaconFilterLimitsDatagramsPerSource() {
+    var filter = BeaconFilter()
+    let source = NSData(bytes: [UInt8(192), 168, 1, 10], length: 4)
+    let otherSource = NSData(bytes: [UInt8(192), 168, 1, 9], length: 4)
+
+    for i in 0 ..< 4 { XCTAssert(filter.admitDatagramFromAddress(source, now: 0), "burst datagram \(i)") }
+    XCTAssertFalse(filter.admitDatagramFromAddress(source, now: 0))
+    XCTAssert(filter.admitDatagramFromAddress(otherSource, now: 0), "sources have their own buckets")
+
+    // Two tokens a second refill the bucket
+    XCTAssert(filter.admitDatagramFromAddress(source, now: 0.5))
+    XCTAssertFalse(filter.admitDatagramFromAddress(source, now: 0.5))
+
+    // The bucket holds no more than a burst however long the source is quiet
+    for i in 0 ..< 4 { XCTAssert(filter.admitDatagramFromAddress(source, now: 60), "refilled datagram \(i)") }
+    XCTAssertFalse(filter.admitDatagramFromAddress(source, now: 60))
+  }
+
+  // MARK: - Message tags
+
+  private struct TestMessage: MessageData {
+    let msg: String
+    var data: NSData { return msg.dataUsingEncoding(NSUTF8StringEncoding)! }
+  }
+
+  private typealias TagTable = MessageTagTable<TestMessage>
+
+  /**
+  entryWithMessage:
+
+  :param: message String
+
+  :returns: MessageQueueEntry<TestMessage>
+  */
+  private func entryWithMessage(message: String) -> MessageQueueEntry<TestMessage> {
+    return MessageQueueEntry(messageData: TestMessage(msg: message))
+  }
+
+  func testMessageTagTableTracksEntriesByTag() {
+    var table = TagTable(capacity: 4)
+    XCTAssert(table.isEmpty)
+
+    let first = table.insert(entryWithMessage("a"))
+    let second = table.insert(entryWithMessage("b"))
+    XCTAssertEqual(first.tag, 0)
+    XCTAssertEqual(second.tag, 1)
+    XCTAssert(first.orphan == nil && second.orphan == nil)
+    XCTAssertEqual(table.count, 2)
+    XCTAssertEqual(table.entryForTag(1)?.message ?? "", "b")
+    XCTAssert(table.stateForTag(0) == .Sending)
+    XCTAssert(table.entryForTag(2) == nil)
+    XCTAssert(table.entryForTag(-1) == nil)
+
+    XCTAssertEqual(table.setState(.Sent, forTag: 0, entry: entryWithMessage("a'"))?.message ?? "", "a'")
+    XCTAssert(table.stateForTag(0) == .Sent)
+    XCTAssert(table.setState(.Sent, forTag: 5) == nil)
+
+    XCTAssertEqual(table.removeEntryForTag(0)?.message ?? "", "a'")
+    XCTAssert(table.removeEntryForTag(0) == nil)
+    XCTAssertEqual(table.count, 1)
+
+    XCTAssert(table.removeEntriesOlderThan(60).isEmpty)
+    let expired = table.removeEntriesOlderThan(-1)
+    XCTAssertEqual(expired.count, 1)
+    XCTAssertEqual(expired.first?.0 ?? -1, 1)
+    XCTAssert(table.isEmpty)
+  }
+
+  func testMessageTagTableEvictsOrphans() {
+    var table = TagTable(capacity: 4)
+    for message in ["a", "b", "c", "d"] { table.insert(entryWithMessage(message)) }
+    let (tag, orphan) = table.insert(entryWithMessage("e"))
+    XCTAssertEqual(tag, 4)
+    XCTAssertEqual(orphan?.message ?? "", "a", "the entry whose slot is reused never received a response")
+    XCTAssert(table.entryForTag(0) == nil)
+    XCTAssertEqual(table.entryForTag(4)?.message ?? "", "e")
+    XCTAssertEqual(table.count, 4)
+
+    let removed = table.removeAll()
+    XCTAssertEqual(removed.map {$0.0}.sorted(<), [1, 2, 3, 4])
+    XCTAssert(table.isEmpty)
+  }
+
+  func testMessageTagTableWrapsTags() {
+    var table = TagTable(capacity: 4)
+    for _ in 0 ..< TagTable.MaxTag { table.insert(entryWithMessage("x")) }
+    let (tag, orphan) = table.insert(entryWithMessage("y"))
+    XCTAssertEqual(tag, 0)
+    XCTAssert(orphan != nil)
+    XCTAssertEqual(table.entryForTag(0)?.message ?? "", "y")
+    XCTAssert(table.entryForTag(TagTable.MaxTag - 4) == nil, "the tag whose slot was reused is gone")
+  }
+
+  // MARK: - Framing
+
+  /** Records the frames a connection delivers */
+  private final class FrameRecorder: NetworkDeviceConnectionDelegate {
+    var frames: [String] = []
+    func connectionDidConnect(connection: NetworkDeviceConnection) {}
+    func connection(connection: NetworkDeviceConnection, didReceiveFrame frame: NSData) {
+      frames.append((NSString(data: frame, encoding: NSUTF8StringEncoding) as? String) ?? "")
+    }
+    func connection(connection: NetworkDeviceConnection, didWriteDataWithTag tag: Int) {}
+    func connectionDidDisconnect(connection: NetworkDeviceConnection, withError error: NSError?) {}
+  }
+
+  /**
+  Feeds each chunk to a connection as a separate read, the channel is opened on one end of a socket pair that is never
+  written so that the chunks are the only bytes the connection sees
+
+  :param: chunks [String]
+
+  :returns: [String] The frames delivered
+  */
+  private func framesForChunks(chunks: [String]) -> [String] {
+    var sockets: [Int32] = [-1, -1]
+    XCTAssertEqual(socketpair(AF_UNIX, SOCK_STREAM, 0, &sockets), Int32(0))
+    let queue = dispatch_queue_create("com.moondeerstudios.tests.framing", DISPATCH_QUEUE_SERIAL)
+    let connection = NetworkDeviceConnection(delegateQueue: queue)
+    let recorder = FrameRecorder()
+    connection.delegate = recorder
+    dispatch_sync(queue) { connection.openChannelWithSocket(sockets[0]) }
+    for chunk in chunks {
+      let bytes = Array(chunk.utf8)
+      dispatch_sync(queue) { connection.receiveBytes(bytes, length: bytes.count) }
+    }
+    dispatch_sync(queue) { connection.disconnect(); return }
+    close(sockets[1])
+    return recorder.frames
+  }
+
+  func testFramesSplitOnDelimiter() {
+    XCTAssertEqual(framesForChunks(["completeir,1:1,1\rcompleteir,1:2,2\r"]),
+                   ["completeir,1:1,1\r", "completeir,1:2,2\r"])
+    XCTAssertEqual(framesForChunks(["busyIR,1:2,", "3\r\ncomplete", "ir,1:3,4\r"]),
+                   ["busyIR,1:2,3\r", "completeir,1:3,4\r"])
+    XCTAssertEqual(framesForChunks(["\r\n", "stopir,1:1\r", "\n"]), ["stopir,1:1\r"])
+  }
+
+  func testFramesThatOutgrowTheReceiveBufferAreDiscarded() {
+    let capacity = NetworkDeviceConnection.ReceiveBufferCapacity
+    let part = String(count: capacity / 2 + 1, repeatedValue: Character("x"))
+
+    // The partial frame overflows while its pieces are appended
+    XCTAssertEqual(framesForChunks(["completeir,1:1,1\r" + part, part, part + "\rstopir,1:1\r"]),
+                   ["completeir,1:1,1\r", "stopir,1:1\r"])
+
+    // The partial frame overflows with the piece that completes it
+    XCTAssertEqual(framesForChunks([part, part + "\r", "stopir,1:1\r"]), ["stopir,1:1\r"])
+
+    // A frame that arrives whole is delivered whatever its length
+    let long = part + part + "\r"
+    XCTAssertEqual(framesForChunks([long]), [long])
+  }
+
 }
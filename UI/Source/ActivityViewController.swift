@@ -11,6 +11,7 @@ import UIKit
 import MoonKit
 import DataModel
 import Settings
+import Networking
 
 public final class ActivityViewController: UIViewController {
 
@@ -63,6 +64,8 @@ public final class ActivityViewController: UIViewController {
         if let remote = $0.change[NSKeyValueChangeNewKey] as? Remote,
           let viewController = $0.observer as? ActivityViewController {
             viewController.insertRemoteView(RemoteView(model: remote))
+            ConnectionManager.prewarmConnectionsForActivity(viewController.activityController.currentActivity,
+                                                     remote: remote)
         }
     })
 
@@ -90,6 +93,8 @@ public final class ActivityViewController: UIViewController {
     self.topToolbarView = topToolbarView
 
     insertRemoteView(RemoteView(model: activityController.currentRemote))
+    ConnectionManager.prewarmConnectionsForActivity(activityController.currentActivity,
+                                             remote: activityController.currentRemote)
   }
 
   /**
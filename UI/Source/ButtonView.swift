@@ -10,6 +10,7 @@ import Foundation
 import UIKit
 import MoonKit
 import DataModel
+import Networking
 
 public class ButtonView: RemoteElementView {
 
@@ -28,6 +29,13 @@ public class ButtonView: RemoteElementView {
   var tapAction: ((Void) -> Void)?
   var pressAction: ((Void) -> Void)?
 
+  /** Rocker buttons (volume, channel) without a long press command stream their IR command while held */
+  var streamsCommandWhileHeld: Bool {
+    return button.longPressCommand == nil
+        && button.command is ITachIRCommand
+        && button.role & RemoteElement.Role.RockerButton == RemoteElement.Role.RockerButton
+  }
+
 	/**
 	executeActionWithOption:
 
@@ -91,7 +99,9 @@ public class ButtonView: RemoteElementView {
 	*/
 	func handleLongPress(gestureRecognizer: UILongPressGestureRecognizer) {
     MSLogDebug("pressed button '\(button.name)'")
-		if gestureRecognizer.state == .Ended {
+    if streamsCommandWhileHeld && !isEditing && pressAction == nil {
+      handleStreamingPress(gestureRecognizer)
+    } else if gestureRecognizer.state == .Ended {
 			pressAction?() ?? executeActionWithOption(.LongPress)
 
 		} else if gestureRecognizer.state == .Possible {
@@ -100,6 +110,26 @@ public class ButtonView: RemoteElementView {
 		}
 	}
 
+  /**
+  Streams the button's command from the moment the press is recognized until the touch lifts
+
+  :param: gestureRecognizer UILongPressGestureRecognizer
+  */
+  private func handleStreamingPress(gestureRecognizer: UILongPressGestureRecognizer) {
+    if let commandID = button.command?.objectID {
+      switch gestureRecognizer.state {
+        case .Began:
+          button.highlighted = true
+          ConnectionManager.beginStreamingCommandWithID(commandID)
+        case .Ended, .Cancelled, .Failed:
+          button.highlighted = false
+          ConnectionManager.endStreamingCommandWithID(commandID)
+        default:
+          break
+      }
+    }
+  }
+
   // MARK: - Internal views
 
   /*weak var labelView: UILabel!*/
@@ -189,7 +219,9 @@ public class ButtonView: RemoteElementView {
     }
     registry["longPressCommand"] = {
       RemoteElementView.dumpObservation($0)
-      ($0.observer as? ButtonView)?.longPressGesture.enabled = ($0.object as? Button)?.longPressCommand != nil
+      if let buttonView = $0.observer as? ButtonView {
+        buttonView.longPressGesture.enabled = buttonView.button.longPressCommand != nil || buttonView.streamsCommandWhileHeld
+      }
     }
     registry["state"] = {
       RemoteElementView.dumpObservation($0)
@@ -203,7 +235,7 @@ public class ButtonView: RemoteElementView {
   /** updateViewFromModel */
   override func updateViewFromModel() {
     super.updateViewFromModel()
-    longPressGesture.enabled = button.longPressCommand != nil
+    longPressGesture.enabled = button.longPressCommand != nil || streamsCommandWhileHeld
     updateStateSensitiveProperties()
   }
 
@@ -221,7 +253,7 @@ public class ButtonView: RemoteElementView {
 	override public var editingMode: RemoteElement.BaseType {
 		didSet {
 			tapGesture.enabled = !isEditing
-			longPressGesture.enabled = !isEditing
+			longPressGesture.enabled = !isEditing && (button.longPressCommand != nil || streamsCommandWhileHeld)
 		}
 	}
 